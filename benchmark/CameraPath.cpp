@@ -0,0 +1,88 @@
+#include "CameraPath.h"
+
+#include <QFile>
+#include <QTextStream>
+
+#include <vsg/maths/transform.h>
+
+#include <algorithm>
+#include <cmath>
+
+bool CameraPath::load(const QString &filename)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+        return false;
+
+    std::vector<KeyFrame> keyFrames;
+
+    QTextStream in(&file);
+    while (!in.atEnd())
+    {
+        const auto line = in.readLine().trimmed();
+        if (line.isEmpty() || line.startsWith('#'))
+            continue;
+
+        const auto values = line.split(' ', Qt::SkipEmptyParts);
+        if (values.size() != 10)
+            return false;
+
+        double v[10];
+        for (int i = 0; i < 10; ++i)
+        {
+            bool ok = false;
+            v[i] = values[i].toDouble(&ok);
+            if (!ok)
+                return false;
+        }
+
+        keyFrames.push_back({v[0], {v[1], v[2], v[3]}, {v[4], v[5], v[6]}, {v[7], v[8], v[9]}});
+    }
+
+    if (keyFrames.empty())
+        return false;
+
+    std::stable_sort(keyFrames.begin(), keyFrames.end(), [](const KeyFrame &lhs, const KeyFrame &rhs) { return lhs.time < rhs.time; });
+
+    _keyFrames = std::move(keyFrames);
+    return true;
+}
+
+CameraPath CameraPath::orbit(const vsg::dbox &bounds, size_t numKeyFrames)
+{
+    const vsg::dvec3 centre = (bounds.min + bounds.max) * 0.5;
+    const double radius = vsg::length(bounds.max - bounds.min) * 0.6 * 3.5;
+
+    CameraPath path;
+    for (size_t i = 0; i <= numKeyFrames; ++i)
+    {
+        const double ratio = static_cast<double>(i) / static_cast<double>(numKeyFrames);
+        const double angle = vsg::radians(ratio * 360.0);
+
+        path._keyFrames.push_back({ratio, centre + vsg::dvec3(std::sin(angle) * radius, -std::cos(angle) * radius, 0.0), centre, {0.0, 0.0, 1.0}});
+    }
+
+    return path;
+}
+
+CameraPath::KeyFrame CameraPath::at(double ratio) const
+{
+    if (_keyFrames.size() == 1)
+        return _keyFrames.front();
+
+    const double first = _keyFrames.front().time;
+    const double last = _keyFrames.back().time;
+    const double time = first + std::clamp(ratio, 0.0, 1.0) * (last - first);
+
+    auto next = std::upper_bound(_keyFrames.begin(), _keyFrames.end(), time, [](double t, const KeyFrame &keyFrame) { return t < keyFrame.time; });
+    if (next == _keyFrames.end())
+        return _keyFrames.back();
+    if (next == _keyFrames.begin())
+        return _keyFrames.front();
+
+    const auto &k1 = *next;
+    const auto &k0 = *(next - 1);
+    const double r = (k1.time > k0.time) ? (time - k0.time) / (k1.time - k0.time) : 0.0;
+
+    return {time, vsg::mix(k0.eye, k1.eye, r), vsg::mix(k0.center, k1.center, r), vsg::normalize(vsg::mix(k0.up, k1.up, r))};
+}
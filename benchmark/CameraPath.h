@@ -0,0 +1,40 @@
+#pragma once
+
+#include <QString>
+
+#include <vsg/maths/box.h>
+#include <vsg/maths/vec3.h>
+
+#include <vector>
+
+// Scripted camera path, one key frame per line:
+//
+//     # time  eye.x eye.y eye.z  center.x center.y center.z  up.x up.y up.z
+//     0.0     0 -10 0            0 0 0                        0 0 1
+//
+// Key frames are interpolated linearly, time is normalized over the benchmark run.
+class CameraPath
+{
+public:
+
+    struct KeyFrame
+    {
+        double time{0.0};
+        vsg::dvec3 eye;
+        vsg::dvec3 center;
+        vsg::dvec3 up;
+    };
+
+    bool load(const QString &filename);
+
+    // a full circle around bounds, used when no path file is given
+    static CameraPath orbit(const vsg::dbox &bounds, size_t numKeyFrames = 36);
+
+    bool empty() const { return _keyFrames.empty(); }
+
+    // ratio runs from 0.0 to 1.0 over the whole path
+    KeyFrame at(double ratio) const;
+
+private:
+    std::vector<KeyFrame> _keyFrames;
+};
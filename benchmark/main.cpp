@@ -0,0 +1,386 @@
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+
+#include "AutoInstancer.h"
+#include "BinaryCache.h"
+#include "CameraPath.h"
+#include "FrameCapture.h"
+#include "FrameProfiler.h"
+#include "LodGenerator.h"
+#include "ParallelRenderGraph.h"
+#include "SceneBounds.h"
+#include "SceneOptimizer.h"
+#include "SceneSetup.h"
+#include "SceneStats.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QStandardPaths>
+#include <QTextStream>
+
+#include <vsg/all.h>
+
+#include <algorithm>
+#include <chrono>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double milliseconds(Clock::time_point start, Clock::time_point end)
+{
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+vsg::ref_ptr<vsg::ImageView> createAttachment(vsg::Device *device, const VkExtent2D &extent, VkFormat format, VkImageUsageFlags usage, VkImageAspectFlags aspectFlags)
+{
+    auto image = vsg::Image::create();
+    image->imageType = VK_IMAGE_TYPE_2D;
+    image->format = format;
+    image->extent = VkExtent3D{extent.width, extent.height, 1};
+    image->mipLevels = 1;
+    image->arrayLayers = 1;
+    image->samples = VK_SAMPLE_COUNT_1_BIT;
+    image->tiling = VK_IMAGE_TILING_OPTIMAL;
+    image->usage = usage;
+    image->initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    image->sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    return vsg::createImageView(device, image, aspectFlags);
+}
+
+QJsonObject toJson(const vsgQt::FrameStats &stats)
+{
+    return {
+        {"samples", static_cast<qint64>(stats.size())},
+        {"min", stats.min()},
+        {"avg", stats.average()},
+        {"p50", stats.percentile(0.50)},
+        {"p90", stats.percentile(0.90)},
+        {"p99", stats.percentile(0.99)},
+        {"max", stats.max()}
+    };
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("vsgQtBenchmark");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Renders a model offscreen along a camera path and reports timings as JSON.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("model", "Model to render, defaults to models/teapot.vsgt from VSG_FILE_PATH.");
+
+    QCommandLineOption pathOption("path", "Camera path file, defaults to an orbit around the model.", "file");
+    QCommandLineOption framesOption("frames", "Number of measured frames.", "count", "300");
+    QCommandLineOption warmupOption("warmup", "Number of frames rendered before measuring.", "count", "30");
+    QCommandLineOption widthOption("width", "Framebuffer width.", "pixels", "1280");
+    QCommandLineOption heightOption("height", "Framebuffer height.", "pixels", "720");
+    QCommandLineOption outputOption("output", "Write the JSON report to file instead of stdout.", "file");
+    QCommandLineOption recordThreadsOption("record-threads", "Record the scene on this many threads into secondary command buffers.", "count", "1");
+    QCommandLineOption lodOption("lod", "Replace dense meshes by generated levels of detail.");
+    QCommandLineOption optimizeOption("optimize", "Share identical state and merge small draws of the model.");
+    QCommandLineOption instanceOption("instance", "Draw repeated copies of the same geometry instanced.");
+    QCommandLineOption binaryCacheOption("binary-cache", "Read .vsgt models through their binary twin in the cache, converted on the first run.");
+    QCommandLineOption sceneStatsOption("scene-stats", "Count draws, primitives, binds and culled nodes of every frame, as View > Scene statistics does.");
+    QCommandLineOption captureOption("capture", "Write the measured frames to directory, as the viewer records them.", "directory");
+    QCommandLineOption captureFormatOption("capture-format", "Image format of captured frames, png or raw.", "format", "png");
+    parser.addOptions({pathOption, framesOption, warmupOption, widthOption, heightOption, outputOption, recordThreadsOption, lodOption, optimizeOption, instanceOption, binaryCacheOption, sceneStatsOption, captureOption, captureFormatOption});
+
+    parser.process(app);
+
+    const int numFrames = std::max(1, parser.value(framesOption).toInt());
+    const int numWarmupFrames = std::max(0, parser.value(warmupOption).toInt());
+    const int recordThreads = std::max(1, parser.value(recordThreadsOption).toInt());
+    const VkExtent2D extent{static_cast<uint32_t>(std::max(1, parser.value(widthOption).toInt())), static_cast<uint32_t>(std::max(1, parser.value(heightOption).toInt()))};
+
+    const auto captureFormat = parser.value(captureFormatOption).toLower();
+    if (captureFormat != "png" && captureFormat != "raw")
+    {
+        qCritical("Invalid capture format %s, expected png or raw.", qPrintable(parser.value(captureFormatOption)));
+        return 1;
+    }
+
+    // no surface, so this runs on software implementations such as lavapipe as well
+    vsg::Names instanceExtensions;
+    vsg::Names requestedLayers;
+    vsg::Names validatedNames = vsg::validateInstancelayerNames(requestedLayers);
+
+    auto instance = vsg::Instance::create(instanceExtensions, validatedNames);
+    auto [physicalDevice, queueFamily] = instance->getPhysicalDeviceAndQueueFamily(VK_QUEUE_GRAPHICS_BIT);
+    if (!physicalDevice || queueFamily < 0)
+    {
+        qCritical("No Vulkan device with graphics support found.");
+        return 1;
+    }
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(*physicalDevice, &properties);
+
+    // vsg::createRenderPass leaves the color attachment in PRESENT_SRC layout
+    vsg::Names deviceExtensions;
+    deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+
+    vsg::QueueSettings queueSettings{vsg::QueueSetting{queueFamily, {1.0}}};
+    auto device = vsg::Device::create(physicalDevice, queueSettings, validatedNames, deviceExtensions);
+
+    const auto positional = parser.positionalArguments();
+
+    vsgQt::BinaryCache binaryCache;
+    if (parser.isSet(binaryCacheOption))
+        binaryCache.setCacheDirectory(QDir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation)).filePath("binary"));
+
+    const auto loadStart = Clock::now();
+    auto model = positional.isEmpty() ? vsgQt::readStartupModel() : binaryCache.read(positional.front());
+    const auto loadTime = milliseconds(loadStart, Clock::now());
+
+    if (!model)
+    {
+        qCritical("Failed to load model.");
+        return 1;
+    }
+
+    // in the order the viewer applies them when it reads a model
+    uint32_t numLodMeshes = 0;
+    if (parser.isSet(lodOption))
+        numLodMeshes = vsgQt::LodGenerator().apply(model);
+
+    vsgQt::SceneOptimizer::Report optimization;
+    if (parser.isSet(optimizeOption))
+        optimization = vsgQt::SceneOptimizer().apply(model);
+    else
+        optimization.before = optimization.after = vsgQt::SceneOptimizer::collectStats(model);
+
+    vsgQt::AutoInstancer::Report instancing;
+    if (parser.isSet(instanceOption))
+    {
+        instancing = vsgQt::AutoInstancer().apply(model);
+        optimization.after = vsgQt::SceneOptimizer::collectStats(model);
+    }
+
+    auto scenegraph = vsg::Group::create();
+    scenegraph->addChild(model);
+
+    const auto bounds = vsgQt::SceneBounds::compute(scenegraph);
+
+    auto cameraSetup = vsgQt::createCamera(bounds, scenegraph, extent);
+
+    CameraPath path;
+    if (parser.isSet(pathOption))
+    {
+        if (!path.load(parser.value(pathOption)))
+        {
+            qCritical("Failed to read camera path %s.", qPrintable(parser.value(pathOption)));
+            return 1;
+        }
+    }
+    else
+    {
+        path = CameraPath::orbit(bounds);
+    }
+
+    // the same render graph set up as VulkanWindow::exposeEvent, into an
+    // offscreen framebuffer. It renders single sampled, where the viewer
+    // uses 4x MSAA, so the report states its sample count.
+    const VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+    const VkFormat colorFormat = VK_FORMAT_R8G8B8A8_UNORM;
+    const VkFormat depthFormat = VK_FORMAT_D32_SFLOAT;
+
+    auto colorImageView = createAttachment(device, extent, colorFormat, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_IMAGE_ASPECT_COLOR_BIT);
+    auto depthImageView = createAttachment(device, extent, depthFormat, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_IMAGE_ASPECT_DEPTH_BIT);
+    auto renderPass = vsg::createRenderPass(device, colorFormat, depthFormat);
+    auto framebuffer = vsg::Framebuffer::create(renderPass, vsg::ImageViews{colorImageView, depthImageView}, extent.width, extent.height, 1);
+
+    auto renderGraph = vsg::RenderGraph::create();
+    renderGraph->camera = cameraSetup.camera;
+    renderGraph->framebuffer = framebuffer;
+    renderGraph->renderArea.offset = {0, 0};
+    renderGraph->renderArea.extent = extent;
+    renderGraph->clearValues.resize(2);
+    renderGraph->clearValues[0].color = {{0.2f, 0.2f, 0.4f, 1.0f}};
+    renderGraph->clearValues[1].depthStencil = {1.0f, 0};
+    renderGraph->addChild(scenegraph);
+
+    auto commandGraph = vsg::CommandGraph::create(device, queueFamily);
+    if (recordThreads > 1)
+    {
+        auto partitions = vsg::Group::create();
+        partitions->getChildren() = vsgQt::partitionScene(scenegraph, static_cast<uint32_t>(recordThreads));
+        commandGraph->addChild(vsgQt::ParallelRenderGraph::create(*renderGraph, partitions, static_cast<uint32_t>(recordThreads)));
+    }
+    else
+    {
+        commandGraph->addChild(renderGraph);
+    }
+
+    vsgQt::FrameProfiler profiler;
+    // every frame waits for the GPU, so only one is in flight
+    profiler.setupGpuTimer(device, commandGraph, 1);
+
+    vsgQt::FrameCapture capture;
+    if (parser.isSet(captureOption))
+        capture.setup(device, colorImageView, commandGraph);
+
+    auto viewer = vsg::Viewer::create();
+    viewer->assignRecordAndSubmitTaskAndPresentation({commandGraph});
+
+    const auto compileStart = Clock::now();
+    viewer->compile();
+    const auto compileTime = milliseconds(compileStart, Clock::now());
+
+    vsgQt::FrameStats frameTimes(static_cast<size_t>(numFrames));
+
+    const bool collectSceneStats = parser.isSet(sceneStatsOption);
+    vsgQt::FrameStats drawCalls(static_cast<size_t>(numFrames));
+    vsgQt::FrameStats indexedPrimitives(static_cast<size_t>(numFrames));
+    vsgQt::FrameStats pipelineBinds(static_cast<size_t>(numFrames));
+    vsgQt::FrameStats descriptorBinds(static_cast<size_t>(numFrames));
+    vsgQt::FrameStats culledNodes(static_cast<size_t>(numFrames));
+
+    for (int frame = 0; frame < numWarmupFrames + numFrames; ++frame)
+    {
+        const bool measured = frame >= numWarmupFrames;
+
+        if (frame == numWarmupFrames && parser.isSet(captureOption))
+        {
+            const auto format = captureFormat == "raw" ? vsgQt::FrameCapture::Format::Raw : vsgQt::FrameCapture::Format::Png;
+            if (!capture.start(parser.value(captureOption), format))
+            {
+                qCritical("Failed to create %s.", qPrintable(parser.value(captureOption)));
+                return 1;
+            }
+        }
+        const double ratio = measured ? static_cast<double>(frame - numWarmupFrames) / static_cast<double>(std::max(1, numFrames - 1)) : 0.0;
+
+        const auto keyFrame = path.at(ratio);
+        cameraSetup.lookAt->eye = keyFrame.eye;
+        cameraSetup.lookAt->center = keyFrame.center;
+        cameraSetup.lookAt->up = keyFrame.up;
+
+        const auto frameStart = Clock::now();
+        auto last = frameStart;
+        auto lap = [&](vsgQt::FrameProfiler::Stage stage) {
+            const auto now = Clock::now();
+            profiler.add(stage, milliseconds(last, now));
+            last = now;
+        };
+
+        profiler.beginFrame();
+
+        if (!viewer->advanceToNextFrame())
+            break;
+        lap(vsgQt::FrameProfiler::Advance);
+
+        viewer->handleEvents();
+        lap(vsgQt::FrameProfiler::Events);
+
+        viewer->update();
+        lap(vsgQt::FrameProfiler::Update);
+
+        if (collectSceneStats && measured)
+        {
+            const auto counters = vsgQt::SceneStats::collect(scenegraph, cameraSetup.camera->projectionMatrix->transform(), cameraSetup.camera->viewMatrix->transform());
+            drawCalls.add(static_cast<double>(counters.drawCalls));
+            indexedPrimitives.add(static_cast<double>(counters.indexedPrimitives));
+            pipelineBinds.add(static_cast<double>(counters.pipelineBinds));
+            descriptorBinds.add(static_cast<double>(counters.descriptorBinds));
+            culledNodes.add(static_cast<double>(counters.culledNodes));
+        }
+        lap(vsgQt::FrameProfiler::SceneStatistics);
+
+        viewer->recordAndSubmit();
+        lap(vsgQt::FrameProfiler::RecordAndSubmit);
+
+        // nothing is presented, wait for the GPU so a frame covers the rendering as well
+        vkDeviceWaitIdle(*device);
+        lap(vsgQt::FrameProfiler::Present);
+
+        // hand the copy to the encoders, the frame does not wait for them
+        capture.collect();
+
+        profiler.endFrame();
+
+        if (measured)
+            frameTimes.add(milliseconds(frameStart, Clock::now()));
+    }
+
+    // the encoders finish the last frames outside of the measurement
+    capture.stop();
+    capture.release();
+    const auto captureStats = capture.stats();
+
+    const auto summary = profiler.summary();
+
+    QJsonObject stages;
+    for (int stage = 0; stage < vsgQt::FrameProfiler::NumStages; ++stage)
+    {
+        stages[vsgQt::FrameProfiler::stageName(static_cast<vsgQt::FrameProfiler::Stage>(stage))] = QJsonObject{
+            {"min", summary.min[stage]},
+            {"avg", summary.average[stage]},
+            {"p99", summary.p99[stage]}
+        };
+    }
+
+    QJsonObject sceneStats;
+    if (collectSceneStats)
+    {
+        sceneStats = QJsonObject{
+            {"drawCalls", toJson(drawCalls)},
+            {"indexedPrimitives", toJson(indexedPrimitives)},
+            {"pipelineBinds", toJson(pipelineBinds)},
+            {"descriptorBinds", toJson(descriptorBinds)},
+            {"culledNodes", toJson(culledNodes)}
+        };
+    }
+
+    QJsonObject report{
+        {"model", positional.isEmpty() ? QString("models/teapot.vsgt") : positional.front()},
+        {"device", QString::fromUtf8(properties.deviceName)},
+        {"driverVersion", static_cast<qint64>(properties.driverVersion)},
+        {"width", static_cast<int>(extent.width)},
+        {"height", static_cast<int>(extent.height)},
+        {"msaaSamples", static_cast<int>(samples)},
+        {"recordThreads", recordThreads},
+        {"lodMeshes", static_cast<int>(numLodMeshes)},
+        {"instancedDraws", QJsonObject{{"draws", static_cast<int>(instancing.instancedDraws)}, {"replaced", static_cast<int>(instancing.replacedDraws)}}},
+        {"drawCalls", QJsonObject{{"before", static_cast<int>(optimization.before.drawCalls)}, {"after", static_cast<int>(optimization.after.drawCalls)}}},
+        {"stateBinds", QJsonObject{{"before", static_cast<int>(optimization.before.stateBinds)}, {"after", static_cast<int>(optimization.after.stateBinds)}}},
+        {"capture", QJsonObject{{"captured", static_cast<qint64>(captureStats.captured)}, {"written", static_cast<qint64>(captureStats.written)}, {"dropped", static_cast<qint64>(captureStats.dropped)}}},
+        {"frames", static_cast<qint64>(frameTimes.size())},
+        {"loadTime", loadTime},
+        {"compileTime", compileTime},
+        {"frameTime", toJson(frameTimes)},
+        {"stages", stages},
+        {"sceneStats", sceneStats}
+    };
+
+    // the binary twin is kept for the next run, the destructor would cancel it
+    binaryCache.waitForDone();
+
+    const auto json = QJsonDocument(report).toJson(QJsonDocument::Indented);
+
+    if (parser.isSet(outputOption))
+    {
+        QFile file(parser.value(outputOption));
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        {
+            qCritical("Failed to write %s.", qPrintable(parser.value(outputOption)));
+            return 1;
+        }
+        file.write(json);
+    }
+    else
+    {
+        QTextStream(stdout) << json;
+    }
+
+    return 0;
+}
@@ -0,0 +1,339 @@
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+
+#include "AutoInstancer.h"
+
+#include <QByteArray>
+#include <QCryptographicHash>
+
+#include <vsg/all.h>
+
+#include <algorithm>
+#include <map>
+#include <regex>
+#include <sstream>
+#include <typeinfo>
+
+namespace {
+
+using StateCommands = vsg::StateGroup::StateCommands;
+
+struct Copy
+{
+    vsg::Group *parent;
+    vsg::ref_ptr<vsg::VertexIndexDraw> draw;
+    vsg::dmat4 matrix;
+};
+
+// collects the draws below the nodes that only pass on state and transforms
+class CollectCopies
+{
+public:
+
+    void collect(vsg::Node *node, vsg::Group *parent, StateCommands &state, const vsg::dmat4 &matrix)
+    {
+        const auto &type = typeid(*node);
+
+        if (auto draw = node->cast<vsg::VertexIndexDraw>())
+        {
+            if (parent && draw->instanceCount == 1 && draw->firstInstance == 0 && !draw->arrays.empty() && draw->indices)
+                copies[{state, contentHash(*draw)}].push_back({parent, vsg::ref_ptr<vsg::VertexIndexDraw>(draw), matrix});
+        }
+        else if (type == typeid(vsg::MatrixTransform))
+        {
+            auto transform = static_cast<vsg::MatrixTransform *>(node);
+            const auto childMatrix = matrix * transform->matrix;
+            for (auto &child : transform->getChildren())
+                collect(child, transform, state, childMatrix);
+        }
+        else if (type == typeid(vsg::StateGroup))
+        {
+            auto stateGroup = static_cast<vsg::StateGroup *>(node);
+            const auto size = state.size();
+            state.insert(state.end(), stateGroup->getStateCommands().begin(), stateGroup->getStateCommands().end());
+            for (auto &child : stateGroup->getChildren())
+                collect(child, stateGroup, state, matrix);
+            state.resize(size);
+        }
+        else if (type == typeid(vsg::Group))
+        {
+            auto group = static_cast<vsg::Group *>(node);
+            for (auto &child : group->getChildren())
+                collect(child, group, state, matrix);
+        }
+    }
+
+    std::map<std::pair<StateCommands, QByteArray>, std::vector<Copy>> copies;
+
+private:
+
+    const QByteArray &contentHash(const vsg::VertexIndexDraw &draw)
+    {
+        auto &result = _hashes[&draw];
+        if (!result.isEmpty())
+            return result;
+
+        QCryptographicHash hash(QCryptographicHash::Sha1);
+        auto add = [&](const vsg::Data *data) {
+            const std::string type = typeid(*data).name();
+            hash.addData(type.data(), static_cast<int>(type.size()));
+            hash.addData(static_cast<const char *>(data->dataPointer()), static_cast<int>(data->dataSize()));
+        };
+
+        for (auto &array : draw.arrays)
+            add(array);
+        add(draw.indices);
+
+        const int32_t range[] = {static_cast<int32_t>(draw.indexCount), static_cast<int32_t>(draw.firstIndex), draw.vertexOffset};
+        hash.addData(reinterpret_cast<const char *>(range), sizeof(range));
+
+        result = hash.result();
+        return result;
+    }
+
+    std::map<const vsg::VertexIndexDraw *, QByteArray> _hashes;
+};
+
+// the instance matrix goes after #version and #extension, and is applied in object space
+std::string patchVertexShader(const std::string &source, uint32_t location)
+{
+    static const std::regex modelView(R"((\w+)\.modelView\b)");
+    if (!std::regex_search(source, modelView))
+        return {};
+
+    auto patched = std::regex_replace(source, modelView, "($1.modelView * vsgQt_instanceMatrix)");
+
+    size_t insert = 0;
+    std::istringstream lines(patched);
+    std::string line;
+    size_t position = 0;
+    while (std::getline(lines, line))
+    {
+        position += line.size() + 1;
+        if (line.rfind("#version", 0) == 0 || line.rfind("#extension", 0) == 0)
+            insert = std::min(position, patched.size());
+    }
+
+    return patched.insert(insert, "layout(location = " + std::to_string(location) + ") in mat4 vsgQt_instanceMatrix;\n");
+}
+
+class PipelineVariants
+{
+public:
+
+    // pipeline that takes the instance matrices from binding numArrays, if it can be made
+    vsg::ref_ptr<vsg::BindGraphicsPipeline> instanced(vsg::BindGraphicsPipeline *bind, uint32_t numArrays)
+    {
+        auto itr = _variants.find({bind, numArrays});
+        if (itr != _variants.end())
+            return itr->second;
+
+        auto &variant = _variants[{bind, numArrays}];
+        variant = create(bind, numArrays);
+        return variant;
+    }
+
+private:
+
+    static vsg::ref_ptr<vsg::BindGraphicsPipeline> create(vsg::BindGraphicsPipeline *bind, uint32_t numArrays)
+    {
+        auto pipeline = bind->pipeline;
+        if (!pipeline)
+            return {};
+
+        uint32_t location = 0;
+        bool hasVertexInput = false;
+
+        vsg::GraphicsPipelineStates states;
+        for (auto &state : pipeline->pipelineStates)
+        {
+            auto vertexInput = state.cast<vsg::VertexInputState>();
+            if (!vertexInput)
+            {
+                states.push_back(state);
+                continue;
+            }
+
+            // every array of the draw has its own binding
+            if (vertexInput->vertexBindingDescriptions.size() != numArrays)
+                return {};
+
+            auto bindings = vertexInput->vertexBindingDescriptions;
+            auto attributes = vertexInput->vertexAttributeDescriptions;
+            for (auto &attribute : attributes)
+                location = std::max(location, attribute.location + 1);
+
+            bindings.push_back(VkVertexInputBindingDescription{numArrays, sizeof(vsg::mat4), VK_VERTEX_INPUT_RATE_INSTANCE});
+            for (uint32_t column = 0; column < 4; ++column)
+                attributes.push_back(VkVertexInputAttributeDescription{location + column, numArrays, VK_FORMAT_R32G32B32A32_SFLOAT, column * static_cast<uint32_t>(sizeof(vsg::vec4))});
+
+            states.push_back(vsg::VertexInputState::create(bindings, attributes));
+            hasVertexInput = true;
+        }
+
+        if (!hasVertexInput)
+            return {};
+
+        vsg::ShaderStages stages;
+        for (auto &stage : pipeline->stages)
+        {
+            if (stage->stage != VK_SHADER_STAGE_VERTEX_BIT)
+            {
+                stages.push_back(stage);
+                continue;
+            }
+
+            if (!stage->module || stage->module->source.empty())
+                return {};
+
+            const auto source = patchVertexShader(stage->module->source, location);
+            if (source.empty())
+                return {};
+
+            auto patched = vsg::ShaderStage::create(stage->stage, stage->entryPointName, vsg::ShaderModule::create(source, stage->module->hints));
+            patched->specializationConstants = stage->specializationConstants;
+            stages.push_back(patched);
+        }
+
+        return vsg::BindGraphicsPipeline::create(vsg::GraphicsPipeline::create(pipeline->layout, stages, states, pipeline->subpass));
+    }
+
+    std::map<std::pair<vsg::BindGraphicsPipeline *, uint32_t>, vsg::ref_ptr<vsg::BindGraphicsPipeline>> _variants;
+};
+
+// the union of the draw's vertex bounds under every instance matrix
+bool instanceBound(const vsg::VertexIndexDraw &draw, const std::vector<Copy> &copies, vsg::dsphere &bound)
+{
+    auto positions = draw.arrays.front().cast<vsg::vec3Array>();
+    if (!positions || positions->valueCount() == 0)
+        return false;
+
+    vsg::dbox local;
+    for (auto &position : *positions)
+        local.add(vsg::dvec3(position));
+
+    vsg::dbox world;
+    for (auto &copy : copies)
+    {
+        for (int corner = 0; corner < 8; ++corner)
+        {
+            const vsg::dvec3 point((corner & 1) ? local.max.x : local.min.x, (corner & 2) ? local.max.y : local.min.y, (corner & 4) ? local.max.z : local.min.z);
+            world.add(copy.matrix * point);
+        }
+    }
+
+    bound = vsg::dsphere((world.min + world.max) * 0.5, vsg::length(world.max - world.min) * 0.5);
+    return true;
+}
+
+// removes the groups left without children
+void prune(vsg::Group *group)
+{
+    auto &children = group->getChildren();
+    for (auto &child : children)
+    {
+        if (auto childGroup = child->cast<vsg::Group>())
+            prune(childGroup);
+    }
+
+    children.erase(std::remove_if(children.begin(), children.end(), [](const vsg::ref_ptr<vsg::Node> &child) {
+                       const auto &type = typeid(*child);
+                       if (type != typeid(vsg::Group) && type != typeid(vsg::MatrixTransform) && type != typeid(vsg::StateGroup))
+                           return false;
+                       return static_cast<vsg::Group *>(child.get())->getChildren().empty();
+                   }),
+                   children.end());
+}
+
+}
+
+using namespace vsgQt;
+
+AutoInstancer::Report AutoInstancer::apply(vsg::ref_ptr<vsg::Node> &node) const
+{
+    Report report;
+    if (!node)
+        return report;
+
+    CollectCopies collect;
+    StateCommands state;
+    collect.collect(node, nullptr, state, vsg::dmat4());
+
+    PipelineVariants variants;
+    vsg::Group::Children instanced;
+
+    for (auto &[key, copies] : collect.copies)
+    {
+        if (copies.size() < _minInstances)
+            continue;
+
+        // the last pipeline bound on the way down is the one drawn with
+        auto commands = key.first;
+        auto bind = std::find_if(commands.rbegin(), commands.rend(), [](const vsg::ref_ptr<vsg::StateCommand> &command) { return command->cast<vsg::BindGraphicsPipeline>() != nullptr; });
+        if (bind == commands.rend())
+            continue;
+
+        // culling and bounds see the instances through a CullGroup around them
+        const auto &original = *copies.front().draw;
+        vsg::dsphere bound;
+        if (!instanceBound(original, copies, bound))
+            continue;
+
+        auto pipeline = variants.instanced(bind->cast<vsg::BindGraphicsPipeline>(), static_cast<uint32_t>(original.arrays.size()));
+        if (!pipeline)
+            continue;
+        *bind = pipeline;
+
+        auto matrices = vsg::mat4Array::create(static_cast<uint32_t>(copies.size()));
+        for (size_t i = 0; i < copies.size(); ++i)
+            (*matrices)[i] = vsg::mat4(copies[i].matrix);
+
+        auto draw = vsg::VertexIndexDraw::create();
+        draw->arrays = original.arrays;
+        draw->arrays.push_back(matrices);
+        draw->indices = original.indices;
+        draw->indexCount = original.indexCount;
+        draw->firstIndex = original.firstIndex;
+        draw->vertexOffset = original.vertexOffset;
+        draw->instanceCount = static_cast<uint32_t>(copies.size());
+
+        auto stateGroup = vsg::StateGroup::create();
+        stateGroup->getStateCommands() = commands;
+        stateGroup->addChild(draw);
+
+        auto cullGroup = vsg::CullGroup::create();
+        cullGroup->bound = bound;
+        cullGroup->addChild(stateGroup);
+        instanced.push_back(cullGroup);
+
+        for (auto &copy : copies)
+        {
+            auto &children = copy.parent->getChildren();
+            auto itr = std::find_if(children.begin(), children.end(), [&](const vsg::ref_ptr<vsg::Node> &child) { return child.get() == copy.draw.get(); });
+            if (itr != children.end())
+                children.erase(itr);
+        }
+
+        ++report.instancedDraws;
+        report.replacedDraws += static_cast<uint32_t>(copies.size());
+    }
+
+    if (instanced.empty())
+        return report;
+
+    // the instance matrices are relative to node, so they are drawn next to it
+    if (typeid(*node) != typeid(vsg::Group))
+    {
+        auto group = vsg::Group::create();
+        group->addChild(node);
+        node = group;
+    }
+
+    auto group = static_cast<vsg::Group *>(node.get());
+    prune(group);
+    for (auto &child : instanced)
+        group->addChild(child);
+
+    return report;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <vsg/core/ref_ptr.h>
+#include <vsg/nodes/Node.h>
+
+#include <cstdint>
+
+namespace vsgQt {
+
+// Replaces repeated copies of the same geometry by one instanced draw. Copies
+// are VertexIndexDraws of identical content below the same state, reached
+// through Groups, StateGroups and MatrixTransforms only. Their transforms go
+// into a per instance mat4 vertex array, and the pipeline gets a variant whose
+// vertex shader applies it after pc.modelView. The instanced draw goes below
+// a CullGroup bounding all instances, next to the model at its root.
+//
+// Only pipelines with GLSL source that use a modelView push constant can be
+// patched, copies drawn with other pipelines are left alone.
+class AutoInstancer
+{
+public:
+
+    struct Report
+    {
+        // instanced draws created, and the copies they replace
+        uint32_t instancedDraws{0};
+        uint32_t replacedDraws{0};
+    };
+
+    explicit AutoInstancer(uint32_t minInstances = 4) : _minInstances(minInstances) {}
+
+    // node is wrapped into a group when it is not one already
+    Report apply(vsg::ref_ptr<vsg::Node> &node) const;
+
+private:
+    uint32_t _minInstances;
+};
+
+}
@@ -0,0 +1,208 @@
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+
+#include "BinaryCache.h"
+#include "FunctionRunnable.h"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QLoggingCategory>
+
+#include <vsg/all.h>
+
+#include <functional>
+#include <istream>
+#include <streambuf>
+
+namespace {
+static QLoggingCategory lc("binarycache");
+
+// a read only stream over memory, the mapped file
+class MemoryBuffer : public std::streambuf
+{
+public:
+
+    MemoryBuffer(const char *data, size_t size)
+    {
+        auto begin = const_cast<char *>(data);
+        setg(begin, begin, begin + size);
+    }
+
+protected:
+
+    pos_type seekoff(off_type offset, std::ios_base::seekdir direction, std::ios_base::openmode which) override
+    {
+        if (!(which & std::ios_base::in))
+            return pos_type(off_type(-1));
+
+        char *position = gptr();
+        if (direction == std::ios_base::beg)
+            position = eback() + offset;
+        else if (direction == std::ios_base::cur)
+            position = gptr() + offset;
+        else
+            position = egptr() + offset;
+
+        if (position < eback() || position > egptr())
+            return pos_type(off_type(-1));
+
+        setg(eback(), position, egptr());
+        return pos_type(position - eback());
+    }
+
+    pos_type seekpos(pos_type position, std::ios_base::openmode which) override
+    {
+        return seekoff(off_type(position), std::ios_base::beg, which);
+    }
+};
+
+}
+
+using namespace vsgQt;
+
+BinaryCache::BinaryCache()
+    : _conversionOptions(vsg::Options::create())
+{
+    // conversions compete with the loader for the CPU, one at a time is enough
+    _pool.setMaxThreadCount(1);
+}
+
+BinaryCache::~BinaryCache()
+{
+    // a conversion cannot be interrupted inside vsg's reader or writer, the
+    // running one stops at the next step
+    _cancelled = true;
+    _pool.clear();
+    _pool.waitForDone();
+}
+
+void BinaryCache::setCacheDirectory(const QString &directory)
+{
+    _cacheDirectory = directory;
+    if (!_cacheDirectory.isEmpty())
+        QDir().mkpath(_cacheDirectory);
+}
+
+void BinaryCache::waitForDone()
+{
+    _pool.waitForDone();
+}
+
+QString BinaryCache::cacheFilename(const QString &filename) const
+{
+    if (_cacheDirectory.isEmpty())
+        return {};
+
+    // a changed source file gives another cache entry for the same path
+    const QFileInfo info(filename);
+    const auto version = QString("%1|%2")
+        .arg(info.size())
+        .arg(info.lastModified().toMSecsSinceEpoch());
+
+    const auto pathHash = QCryptographicHash::hash(info.absoluteFilePath().toUtf8(), QCryptographicHash::Sha1).toHex();
+    const auto versionHash = QCryptographicHash::hash(version.toUtf8(), QCryptographicHash::Sha1).toHex();
+    return QDir(_cacheDirectory).filePath(QString::fromLatin1(pathHash + '_' + versionHash) + ".vsgb");
+}
+
+void BinaryCache::removeStaleTwins(const QString &cached) const
+{
+    const QFileInfo info(cached);
+    const auto prefix = info.fileName().section('_', 0, 0);
+
+    QDir directory(info.absolutePath());
+    for (auto &name : directory.entryList({prefix + "_*.vsgb"}, QDir::Files))
+    {
+        if (name != info.fileName() && !name.endsWith(".part.vsgb"))
+            directory.remove(name);
+    }
+}
+
+vsg::ref_ptr<vsg::Node> BinaryCache::read(const QString &filename, vsg::ref_ptr<const vsg::Options> options)
+{
+    const auto suffix = QFileInfo(filename).suffix().toLower();
+
+    if (suffix == "vsgb")
+        return readMapped(filename, options).cast<vsg::Node>();
+
+    if (suffix != "vsgt")
+        return vsg::read_cast<vsg::Node>(filename.toStdString(), options);
+
+    const auto cached = cacheFilename(filename);
+    if (!cached.isEmpty() && QFileInfo::exists(cached))
+    {
+        if (auto node = readMapped(cached, options).cast<vsg::Node>())
+        {
+            qCDebug(lc) << "Read" << filename << "from" << cached;
+            return node;
+        }
+    }
+
+    auto node = vsg::read_cast<vsg::Node>(filename.toStdString(), options);
+    if (node && !cached.isEmpty())
+        convert(filename, cached);
+
+    return node;
+}
+
+void BinaryCache::convert(const QString &filename, const QString &cached)
+{
+    {
+        std::scoped_lock lock(_mutex);
+        if (!_converting.insert(cached).second)
+            return;
+    }
+
+    // the caller goes on changing its own copy of the model, so the
+    // conversion reads the source again instead of writing that one
+    _pool.start(new FunctionRunnable([this, filename, cached]() {
+        const auto partial = cached + ".part.vsgb";
+
+        auto object = _cancelled ? vsg::ref_ptr<vsg::Object>() : vsg::read(filename.toStdString(), _conversionOptions);
+        const bool written = object && !_cancelled && vsg::write(object, partial.toStdString());
+
+        // abandoned on shutdown
+        if (_cancelled)
+        {
+            QFile::remove(partial);
+        }
+        else if (written)
+        {
+            QFile::remove(cached);
+            if (QFile::rename(partial, cached))
+            {
+                removeStaleTwins(cached);
+                qCDebug(lc) << "Converted" << filename << "to" << cached;
+            }
+        }
+        else
+        {
+            QFile::remove(partial);
+            qCWarning(lc) << "Could not convert" << filename << "to" << cached;
+        }
+
+        std::scoped_lock lock(_mutex);
+        _converting.erase(cached);
+    }));
+}
+
+vsg::ref_ptr<vsg::Object> BinaryCache::readMapped(const QString &filename, vsg::ref_ptr<const vsg::Options> options)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly) || file.size() == 0)
+        return {};
+
+    auto data = file.map(0, file.size());
+    if (!data)
+        return vsg::read(filename.toStdString(), options);
+
+    MemoryBuffer buffer(reinterpret_cast<const char *>(data), static_cast<size_t>(file.size()));
+    std::istream stream(&buffer);
+    auto object = vsg::VSG().read(stream, options);
+
+    file.unmap(data);
+    return object;
+}
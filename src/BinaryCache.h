@@ -0,0 +1,60 @@
+#pragma once
+
+#include <QString>
+#include <QThreadPool>
+
+#include <vsg/core/ref_ptr.h>
+#include <vsg/io/Options.h>
+#include <vsg/nodes/Node.h>
+
+#include <atomic>
+#include <mutex>
+#include <set>
+
+namespace vsgQt {
+
+// Reads models with binary .vsgb files in place of the slow to parse .vsgt.
+// The first read of a .vsgt converts it into a binary twin in the cache
+// directory on a background thread, later reads use the twin as long as the
+// source keeps its size and modification time. A new twin replaces the one
+// of the previous version of the source. Conversions still queued when the
+// cache is destroyed are dropped, a running one leaves no partial file.
+//
+// Binary files are read from a memory mapping of the whole file rather than
+// through a file stream. vsg's reader still allocates the arrays it reads,
+// so the data is copied once from the mapping.
+class BinaryCache
+{
+public:
+
+    BinaryCache();
+    ~BinaryCache();
+
+    // no conversion when empty
+    void setCacheDirectory(const QString &directory);
+
+    vsg::ref_ptr<vsg::Node> read(const QString &filename, vsg::ref_ptr<const vsg::Options> options = {});
+
+    // waits for the queued conversions to finish, the destructor cancels them
+    void waitForDone();
+
+    static vsg::ref_ptr<vsg::Object> readMapped(const QString &filename, vsg::ref_ptr<const vsg::Options> options = {});
+
+private:
+
+    // twins of one source path share the prefix before the '_'
+    QString cacheFilename(const QString &filename) const;
+    void removeStaleTwins(const QString &cached) const;
+    void convert(const QString &filename, const QString &cached);
+
+    QString _cacheDirectory;
+    QThreadPool _pool;
+    // conversions read the source with options of their own, not the caller's
+    vsg::ref_ptr<vsg::Options> _conversionOptions;
+
+    std::mutex _mutex;
+    std::set<QString> _converting;
+    std::atomic<bool> _cancelled{false};
+};
+
+}
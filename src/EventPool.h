@@ -0,0 +1,79 @@
+#pragma once
+
+#include <vsg/core/ref_ptr.h>
+#include <vsg/ui/PointerEvent.h>
+#include <vsg/ui/ScrollWheelEvent.h>
+
+#include <vector>
+
+namespace vsgQt {
+
+// Recycles the high rate input events. An event can be handed out again once
+// the viewer has dropped it, i.e. once the pool holds the only reference.
+class EventPool
+{
+public:
+
+    static constexpr size_t Capacity = 256;
+
+    vsg::ref_ptr<vsg::MoveEvent> moveEvent(vsg::Window *window, vsg::clock::time_point time, int32_t x, int32_t y, vsg::ButtonMask mask)
+    {
+        if (auto event = reuse(_moveEvents, _nextMoveEvent))
+        {
+            event->time = time;
+            event->x = x;
+            event->y = y;
+            event->mask = mask;
+            return event;
+        }
+
+        return keep(_moveEvents, vsg::MoveEvent::create(window, time, x, y, mask));
+    }
+
+    vsg::ref_ptr<vsg::ScrollWheelEvent> scrollWheelEvent(vsg::Window *window, vsg::clock::time_point time, const vsg::vec3 &delta)
+    {
+        if (auto event = reuse(_scrollWheelEvents, _nextScrollWheelEvent))
+        {
+            event->time = time;
+            event->delta = delta;
+            return event;
+        }
+
+        return keep(_scrollWheelEvents, vsg::ScrollWheelEvent::create(window, time, delta));
+    }
+
+private:
+
+    template<class T>
+    static vsg::ref_ptr<T> reuse(std::vector<vsg::ref_ptr<T>> &events, size_t &next)
+    {
+        for (size_t i = 0; i < events.size(); ++i)
+        {
+            auto &event = events[(next + i) % events.size()];
+            if (event->referenceCount() == 1)
+            {
+                next = (next + i + 1) % events.size();
+                return event;
+            }
+        }
+
+        return {};
+    }
+
+    template<class T>
+    static vsg::ref_ptr<T> keep(std::vector<vsg::ref_ptr<T>> &events, vsg::ref_ptr<T> event)
+    {
+        // beyond the capacity events are allocated as before
+        if (events.size() < Capacity)
+            events.push_back(event);
+
+        return event;
+    }
+
+    std::vector<vsg::ref_ptr<vsg::MoveEvent>> _moveEvents;
+    std::vector<vsg::ref_ptr<vsg::ScrollWheelEvent>> _scrollWheelEvents;
+    size_t _nextMoveEvent{0};
+    size_t _nextScrollWheelEvent{0};
+};
+
+}
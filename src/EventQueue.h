@@ -0,0 +1,122 @@
+#pragma once
+
+#include <vsg/core/ref_ptr.h>
+#include <vsg/ui/PointerEvent.h>
+#include <vsg/ui/UIEvent.h>
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+namespace vsgQt {
+
+// Lock-free single producer / single consumer ring buffer of UI events. The
+// Qt GUI thread pushes input, the thread running the vsg::Viewer frame loop
+// drains it in pollEvents().
+//
+// No event is dropped when the ring is full. Later events go to an overflow
+// list behind a mutex until the consumer has taken it, consecutive pointer
+// moves with the same buttons collapse into the latest one there.
+class EventQueue
+{
+public:
+
+    static constexpr size_t Capacity = 4096;
+
+    void push(vsg::ref_ptr<vsg::UIEvent> event)
+    {
+        // only the producer sets the flag, so a clear one stays clear
+        if (!_overflowing.load(std::memory_order_acquire))
+        {
+            const auto tail = _tail.load(std::memory_order_relaxed);
+            const auto next = (tail + 1) % Capacity;
+
+            if (next != _head.load(std::memory_order_acquire))
+            {
+                _events[tail] = std::move(event);
+                _tail.store(next, std::memory_order_release);
+                return;
+            }
+        }
+
+        std::scoped_lock lock(_overflowMutex);
+        _overflowing.store(true, std::memory_order_release);
+
+        if (!_overflow.empty())
+        {
+            auto lastMove = _overflow.back()->cast<vsg::MoveEvent>();
+            auto move = event->cast<vsg::MoveEvent>();
+            if (lastMove && move && lastMove->mask == move->mask)
+            {
+                _overflow.back() = std::move(event);
+                ++_coalesced;
+                return;
+            }
+        }
+
+        _overflow.emplace_back(std::move(event));
+    }
+
+    bool empty() const
+    {
+        return _head.load(std::memory_order_acquire) == _tail.load(std::memory_order_acquire) && !_overflowing.load(std::memory_order_acquire);
+    }
+
+    bool drain(vsg::UIEvents &events)
+    {
+        return consume([&events](vsg::ref_ptr<vsg::UIEvent> event) { events.emplace_back(std::move(event)); });
+    }
+
+    // hands every queued event to func, in the order they were pushed
+    template<typename F>
+    bool consume(F func)
+    {
+        auto head = _head.load(std::memory_order_relaxed);
+        auto tail = _tail.load(std::memory_order_acquire);
+        std::vector<vsg::ref_ptr<vsg::UIEvent>> overflow;
+
+        if (_overflowing.load(std::memory_order_acquire))
+        {
+            // while overflowing the producer leaves the ring alone, so its
+            // events all precede the overflow list
+            std::scoped_lock lock(_overflowMutex);
+            tail = _tail.load(std::memory_order_acquire);
+            overflow.swap(_overflow);
+            _overflowing.store(false, std::memory_order_release);
+        }
+
+        if (head == tail && overflow.empty())
+            return false;
+
+        for (; head != tail; head = (head + 1) % Capacity)
+        {
+            func(std::move(_events[head]));
+            _events[head] = {};
+        }
+
+        _head.store(head, std::memory_order_release);
+
+        for (auto &event : overflow)
+            func(std::move(event));
+
+        return true;
+    }
+
+    // pointer moves replaced by a later one while the ring was full
+    size_t coalesced() const { return _coalesced; }
+
+private:
+
+    std::array<vsg::ref_ptr<vsg::UIEvent>, Capacity> _events;
+    std::atomic<size_t> _head{0};
+    std::atomic<size_t> _tail{0};
+
+    std::mutex _overflowMutex;
+    std::atomic<bool> _overflowing{false};
+    std::vector<vsg::ref_ptr<vsg::UIEvent>> _overflow;
+    std::atomic<size_t> _coalesced{0};
+};
+
+}
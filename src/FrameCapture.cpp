@@ -0,0 +1,537 @@
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+
+#include "FrameCapture.h"
+#include "FunctionRunnable.h"
+
+#include <QDir>
+#include <QFile>
+#include <QImage>
+#include <QLoggingCategory>
+#include <QThread>
+
+#include <vsg/all.h>
+
+#include <algorithm>
+#include <mutex>
+
+namespace {
+static QLoggingCategory lc("framecapture");
+
+// staging buffers are only allocated when a frame finds no free one, so a
+// worker pool that keeps up uses about as many as there are frames in flight
+constexpr size_t NumSlots = 8;
+
+// a low zlib level, at full resolution encoding speed matters more than size
+constexpr int PngQuality = 80;
+
+bool isSupportedFormat(VkFormat format)
+{
+    switch (format)
+    {
+    case VK_FORMAT_B8G8R8A8_UNORM:
+    case VK_FORMAT_B8G8R8A8_SRGB:
+    case VK_FORMAT_R8G8B8A8_UNORM:
+    case VK_FORMAT_R8G8B8A8_SRGB:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool isBgra(VkFormat format)
+{
+    return format == VK_FORMAT_B8G8R8A8_UNORM || format == VK_FORMAT_B8G8R8A8_SRGB;
+}
+}
+
+namespace vsgQt {
+
+class FrameCapture::Ring : public vsg::Inherit<vsg::Object, Ring>
+{
+public:
+
+    struct Slot
+    {
+        enum State
+        {
+            Free,
+            Copying,
+            Encoding
+        };
+
+        VkBuffer buffer{VK_NULL_HANDLE};
+        VkDeviceMemory memory{VK_NULL_HANDLE};
+        VkDeviceSize size{0};
+        void *mapped{nullptr};
+        VkEvent event{VK_NULL_HANDLE};
+        State state{Free};
+        uint64_t frame{0};
+        VkExtent2D extent{0, 0};
+        VkFormat format{VK_FORMAT_UNDEFINED};
+    };
+
+    // what a worker needs to write one slot, copied out under the lock
+    struct Job
+    {
+        size_t index;
+        const void *data;
+        uint64_t frame;
+        VkExtent2D extent;
+        VkFormat format;
+        QString directory;
+        FrameCapture::Format fileFormat;
+    };
+
+    Ring(vsg::Device *device, vsg::Window *window, vsg::ImageView *colorImage)
+        : _device(device)
+        , _window(window)
+        , _colorImage(colorImage)
+        , _slots(NumSlots)
+    {
+        VkPhysicalDeviceMemoryProperties properties;
+        vkGetPhysicalDeviceMemoryProperties(*_device->getPhysicalDevice(), &properties);
+        _memoryProperties = properties;
+    }
+
+    void start(const QString &directory, FrameCapture::Format format)
+    {
+        std::scoped_lock lock(_mutex);
+        _directory = directory;
+        _format = format;
+        _nextFrame = 0;
+        _stats = {};
+        _recording = true;
+        _started = true;
+    }
+
+    void stop()
+    {
+        std::scoped_lock lock(_mutex);
+        _recording = false;
+    }
+
+    bool isRecording() const
+    {
+        std::scoped_lock lock(_mutex);
+        return _recording;
+    }
+
+    bool isStarted() const
+    {
+        std::scoped_lock lock(_mutex);
+        return _started;
+    }
+
+    bool isBusy() const
+    {
+        std::scoped_lock lock(_mutex);
+        return std::any_of(_slots.begin(), _slots.end(), [](const Slot &slot) { return slot.state != Slot::Free; });
+    }
+
+    FrameCapture::Stats stats() const
+    {
+        std::scoped_lock lock(_mutex);
+        return _stats;
+    }
+
+    void record(vsg::CommandBuffer &commandBuffer)
+    {
+        std::scoped_lock lock(_mutex);
+
+        if (!_recording)
+            return;
+
+        vsg::ref_ptr<vsg::Image> image;
+        VkExtent2D extent;
+        VkFormat format;
+        if (_window)
+        {
+            const auto imageIndex = _window->imageIndex();
+            if (imageIndex >= _window->numFrames())
+                return;
+
+            image = _window->imageView(imageIndex)->image;
+            extent = _window->extent2D();
+            format = _window->surfaceFormat().format;
+        }
+        else
+        {
+            image = _colorImage->image;
+            extent = VkExtent2D{image->extent.width, image->extent.height};
+            format = image->format;
+        }
+
+        if (!image || !isSupportedFormat(format))
+            return;
+
+        auto itr = std::find_if(_slots.begin(), _slots.end(), [](const Slot &slot) { return slot.state == Slot::Free; });
+        if (itr == _slots.end())
+        {
+            ++_stats.dropped;
+            return;
+        }
+
+        auto &slot = *itr;
+        const VkDeviceSize size = static_cast<VkDeviceSize>(extent.width) * extent.height * 4;
+        if (slot.size < size && !allocate(slot, size))
+        {
+            ++_stats.failed;
+            return;
+        }
+
+        slot.state = Slot::Copying;
+        slot.frame = _nextFrame++;
+        slot.extent = extent;
+        slot.format = format;
+        ++_stats.captured;
+
+        const VkImage vkImage = image->vk(commandBuffer.deviceID);
+
+        // the render pass leaves the color image ready to present
+        VkImageMemoryBarrier toTransfer = {};
+        toTransfer.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        toTransfer.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        toTransfer.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        toTransfer.oldLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+        toTransfer.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        toTransfer.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        toTransfer.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        toTransfer.image = vkImage;
+        toTransfer.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &toTransfer);
+
+        VkBufferImageCopy region = {};
+        region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+        region.imageExtent = VkExtent3D{extent.width, extent.height, 1};
+        vkCmdCopyImageToBuffer(commandBuffer, vkImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot.buffer, 1, &region);
+
+        VkImageMemoryBarrier toPresent = toTransfer;
+        toPresent.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        toPresent.dstAccessMask = 0;
+        toPresent.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        toPresent.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+        VkBufferMemoryBarrier toHost = {};
+        toHost.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        toHost.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        toHost.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+        toHost.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        toHost.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        toHost.buffer = slot.buffer;
+        toHost.offset = 0;
+        toHost.size = VK_WHOLE_SIZE;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT | VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 1, &toHost, 1, &toPresent);
+
+        // polled by collect() instead of waiting on the frame's fence
+        vkCmdSetEvent(commandBuffer, slot.event, VK_PIPELINE_STAGE_TRANSFER_BIT);
+    }
+
+    // the copies the GPU has finished, their slots move on to encoding
+    std::vector<Job> takeCopied()
+    {
+        std::scoped_lock lock(_mutex);
+
+        std::vector<Job> jobs;
+        for (size_t i = 0; i < _slots.size(); ++i)
+        {
+            auto &slot = _slots[i];
+            if (slot.state != Slot::Copying || vkGetEventStatus(*_device, slot.event) != VK_EVENT_SET)
+                continue;
+
+            slot.state = Slot::Encoding;
+            jobs.push_back({i, slot.mapped, slot.frame, slot.extent, slot.format, _directory, _format});
+        }
+
+        return jobs;
+    }
+
+    void finish(size_t index, bool written)
+    {
+        std::scoped_lock lock(_mutex);
+
+        auto &slot = _slots[index];
+        vkResetEvent(*_device, slot.event);
+        slot.state = Slot::Free;
+
+        if (written)
+            ++_stats.written;
+        else
+            ++_stats.failed;
+    }
+
+    // copies that will not complete any more, e.g. of a command buffer that
+    // was never submitted, count as dropped instead of captured
+    void abandon()
+    {
+        std::scoped_lock lock(_mutex);
+
+        for (auto &slot : _slots)
+        {
+            if (slot.state != Slot::Copying)
+                continue;
+
+            vkResetEvent(*_device, slot.event);
+            slot.state = Slot::Free;
+            --_stats.captured;
+            ++_stats.dropped;
+        }
+    }
+
+    void waitIdle()
+    {
+        vkDeviceWaitIdle(*_device);
+    }
+
+protected:
+
+    virtual ~Ring()
+    {
+        // command buffers still in flight may copy into the buffers
+        vkDeviceWaitIdle(*_device);
+
+        for (auto &slot : _slots)
+            destroy(slot);
+    }
+
+    bool allocate(Slot &slot, VkDeviceSize size)
+    {
+        destroy(slot);
+
+        VkBufferCreateInfo bufferInfo = {};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = size;
+        bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        if (vkCreateBuffer(*_device, &bufferInfo, nullptr, &slot.buffer) != VK_SUCCESS)
+            return false;
+
+        VkMemoryRequirements requirements;
+        vkGetBufferMemoryRequirements(*_device, slot.buffer, &requirements);
+
+        // cached memory, where there is some, is much faster for the workers to read
+        const VkMemoryPropertyFlags coherent = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        auto memoryType = findMemoryType(requirements.memoryTypeBits, coherent | VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+        if (memoryType < 0)
+            memoryType = findMemoryType(requirements.memoryTypeBits, coherent);
+
+        VkMemoryAllocateInfo allocateInfo = {};
+        allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocateInfo.allocationSize = requirements.size;
+        allocateInfo.memoryTypeIndex = static_cast<uint32_t>(memoryType);
+
+        VkEventCreateInfo eventInfo = {};
+        eventInfo.sType = VK_STRUCTURE_TYPE_EVENT_CREATE_INFO;
+
+        if (memoryType < 0
+            || vkAllocateMemory(*_device, &allocateInfo, nullptr, &slot.memory) != VK_SUCCESS
+            || vkBindBufferMemory(*_device, slot.buffer, slot.memory, 0) != VK_SUCCESS
+            || vkMapMemory(*_device, slot.memory, 0, VK_WHOLE_SIZE, 0, &slot.mapped) != VK_SUCCESS
+            || vkCreateEvent(*_device, &eventInfo, nullptr, &slot.event) != VK_SUCCESS)
+        {
+            qCWarning(lc) << "Could not allocate a staging buffer of" << size << "bytes";
+            destroy(slot);
+            return false;
+        }
+
+        slot.size = size;
+        return true;
+    }
+
+    void destroy(Slot &slot)
+    {
+        if (slot.event != VK_NULL_HANDLE)
+            vkDestroyEvent(*_device, slot.event, nullptr);
+        if (slot.mapped)
+            vkUnmapMemory(*_device, slot.memory);
+        if (slot.buffer != VK_NULL_HANDLE)
+            vkDestroyBuffer(*_device, slot.buffer, nullptr);
+        if (slot.memory != VK_NULL_HANDLE)
+            vkFreeMemory(*_device, slot.memory, nullptr);
+
+        slot = Slot();
+    }
+
+    int findMemoryType(uint32_t typeBits, VkMemoryPropertyFlags flags) const
+    {
+        for (uint32_t i = 0; i < _memoryProperties.memoryTypeCount; ++i)
+        {
+            if ((typeBits & (1u << i)) && (_memoryProperties.memoryTypes[i].propertyFlags & flags) == flags)
+                return static_cast<int>(i);
+        }
+
+        return -1;
+    }
+
+    vsg::ref_ptr<vsg::Device> _device;
+    vsg::ref_ptr<vsg::Window> _window;
+    vsg::ref_ptr<vsg::ImageView> _colorImage;
+    VkPhysicalDeviceMemoryProperties _memoryProperties;
+
+    mutable std::mutex _mutex;
+    std::vector<Slot> _slots;
+    bool _recording{false};
+    bool _started{false};
+    QString _directory;
+    FrameCapture::Format _format{FrameCapture::Format::Png};
+    uint64_t _nextFrame{0};
+    FrameCapture::Stats _stats;
+};
+
+class CopyToStaging : public vsg::Inherit<vsg::Command, CopyToStaging>
+{
+public:
+
+    explicit CopyToStaging(FrameCapture::Ring *ring) : _ring(ring) {}
+
+    const FrameCapture::Ring *ring() const { return _ring.get(); }
+
+    void record(vsg::CommandBuffer &commandBuffer) const override
+    {
+        _ring->record(commandBuffer);
+    }
+
+private:
+    vsg::ref_ptr<FrameCapture::Ring> _ring;
+};
+
+}
+
+using namespace vsgQt;
+
+FrameCapture::FrameCapture()
+{
+    _pool.setMaxThreadCount(std::max(1, QThread::idealThreadCount() / 2));
+}
+
+FrameCapture::~FrameCapture()
+{
+    release();
+}
+
+bool FrameCapture::setup(vsg::Window *window, vsg::Group *commandGraph)
+{
+    if (!(window->traits()->swapchainPreferences.imageUsage & VK_IMAGE_USAGE_TRANSFER_SRC_BIT))
+    {
+        qCWarning(lc) << "Swapchain images cannot be copied from, frame capture is disabled.";
+        return false;
+    }
+
+    return setup(Ring::create(window->getOrCreateDevice(), window, nullptr), commandGraph);
+}
+
+bool FrameCapture::setup(vsg::Device *device, vsg::ImageView *colorImage, vsg::Group *commandGraph)
+{
+    return setup(Ring::create(device, nullptr, colorImage), commandGraph);
+}
+
+bool FrameCapture::setup(vsg::ref_ptr<Ring> ring, vsg::Group *commandGraph)
+{
+    release();
+
+    // after the render graphs, outside of any render pass
+    commandGraph->addChild(CopyToStaging::create(ring));
+
+    _ring = ring;
+    _commandGraph = commandGraph;
+    return true;
+}
+
+void FrameCapture::release()
+{
+    if (!_ring)
+        return;
+
+    stop();
+
+    // copies already submitted are written, the others count as dropped
+    _ring->waitIdle();
+    collect();
+    _pool.waitForDone();
+    _ring->abandon();
+
+    auto &children = _commandGraph->getChildren();
+    children.erase(std::remove_if(children.begin(), children.end(), [&](const vsg::ref_ptr<vsg::Node> &child) {
+                       auto copy = child->cast<CopyToStaging>();
+                       return copy && copy->ring() == _ring.get();
+                   }),
+                   children.end());
+
+    if (_ring->isStarted())
+        _stats = _ring->stats();
+
+    _ring = {};
+    _commandGraph = {};
+}
+
+bool FrameCapture::start(const QString &directory, Format format)
+{
+    if (!_ring)
+        return false;
+
+    if (!QDir().mkpath(directory))
+    {
+        qCWarning(lc) << "Could not create" << directory;
+        return false;
+    }
+
+    _ring->start(directory, format);
+    return true;
+}
+
+void FrameCapture::stop()
+{
+    if (_ring)
+        _ring->stop();
+}
+
+bool FrameCapture::isRecording() const
+{
+    return _ring && _ring->isRecording();
+}
+
+bool FrameCapture::isBusy() const
+{
+    return _ring && _ring->isBusy();
+}
+
+void FrameCapture::collect()
+{
+    if (!_ring)
+        return;
+
+    for (auto &job : _ring->takeCopied())
+    {
+        _pool.start(new FunctionRunnable([ring = _ring, job]() {
+            const auto width = static_cast<int>(job.extent.width);
+            const auto height = static_cast<int>(job.extent.height);
+            const auto bytes = static_cast<qint64>(width) * height * 4;
+            const auto name = QString("frame_%1").arg(job.frame, 6, 10, QChar('0'));
+
+            bool written = false;
+            if (job.fileFormat == Format::Png)
+            {
+                // the unused alpha of the swapchain is ignored, RGB32 is BGRA in memory on little endian hosts
+                const QImage image(static_cast<const uchar *>(job.data), width, height, width * 4, isBgra(job.format) ? QImage::Format_RGB32 : QImage::Format_RGBX8888);
+                written = image.save(QDir(job.directory).filePath(name + ".png"), "PNG", PngQuality);
+            }
+            else
+            {
+                QFile file(QDir(job.directory).filePath(QString("%1_%2x%3.%4").arg(name).arg(width).arg(height).arg(isBgra(job.format) ? "bgra" : "rgba")));
+                written = file.open(QIODevice::WriteOnly | QIODevice::Truncate) && file.write(static_cast<const char *>(job.data), bytes) == bytes;
+            }
+
+            if (!written)
+                qCWarning(lc) << "Could not write frame" << job.frame << "to" << job.directory;
+
+            ring->finish(job.index, written);
+        }));
+    }
+}
+
+FrameCapture::Stats FrameCapture::stats() const
+{
+    return _ring && _ring->isStarted() ? _ring->stats() : _stats;
+}
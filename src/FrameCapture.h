@@ -0,0 +1,82 @@
+#pragma once
+
+#include <QString>
+#include <QThreadPool>
+
+#include <vsg/core/ref_ptr.h>
+#include <vsg/nodes/Group.h>
+#include <vsg/state/ImageView.h>
+#include <vsg/viewer/Window.h>
+#include <vsg/vk/Device.h>
+
+#include <cstdint>
+
+namespace vsgQt {
+
+// Records rendered frames to an image sequence without stalling the frame
+// loop. A command after the render graphs copies the color image into one
+// of a ring of host visible staging buffers and sets an event. collect()
+// polls the events after present and hands finished copies to a pool of
+// worker threads, which write them straight from the mapped memory. When
+// every buffer is still in use the frame is dropped instead of waited for.
+class FrameCapture
+{
+public:
+
+    enum class Format
+    {
+        Png,
+        Raw
+    };
+
+    struct Stats
+    {
+        uint64_t captured{0};
+        uint64_t written{0};
+        uint64_t dropped{0};
+        uint64_t failed{0};
+    };
+
+    FrameCapture();
+    ~FrameCapture();
+
+    // copies the current swapchain image of window after the other children
+    // of commandGraph, fails when the swapchain lacks the TRANSFER_SRC usage
+    bool setup(vsg::Window *window, vsg::Group *commandGraph);
+
+    // the same for an offscreen color attachment left in PRESENT_SRC layout
+    bool setup(vsg::Device *device, vsg::ImageView *colorImage, vsg::Group *commandGraph);
+
+    // ends a recording, writes the copies the GPU has made and removes the
+    // copy command from the command graph. stats() keeps reporting the last
+    // recording, also after setting up again until the next start().
+    void release();
+
+    // frames are written as frame_000000.png, or as frame_000000_WxH.bgra
+    // or .rgba in the byte order of the color image
+    bool start(const QString &directory, Format format);
+    void stop();
+    bool isRecording() const;
+
+    // frames are still copied or written, also after stop() until collect()
+    // has handed the last copy to the workers and they are done with it
+    bool isBusy() const;
+
+    // hands the copies the GPU has finished to the workers, call once per frame
+    void collect();
+
+    Stats stats() const;
+
+    class Ring;
+
+private:
+    bool setup(vsg::ref_ptr<Ring> ring, vsg::Group *commandGraph);
+
+    QThreadPool _pool;
+    vsg::ref_ptr<Ring> _ring;
+    vsg::ref_ptr<vsg::Group> _commandGraph;
+    // of the last recording, once released
+    Stats _stats;
+};
+
+}
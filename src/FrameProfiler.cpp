@@ -0,0 +1,398 @@
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+
+#include "FrameProfiler.h"
+
+#include <QFile>
+#include <QLoggingCategory>
+#include <QTextStream>
+
+#include <vsg/all.h>
+
+#include <algorithm>
+#include <atomic>
+#include <numeric>
+
+namespace {
+static QLoggingCategory lc("frameprofiler");
+
+// keep the CSV history bounded, a bit more than an hour at 60Hz
+constexpr size_t MaxHistory = 1 << 18;
+}
+
+namespace vsgQt {
+
+class FrameProfiler::GpuTimer : public vsg::Inherit<vsg::Object, GpuTimer>
+{
+public:
+
+    GpuTimer(vsg::Device *device, uint32_t numFrameSlots, uint32_t numTimestamps, double timestampPeriod, uint32_t timestampValidBits)
+        : _device(device)
+        , _numFrameSlots(numFrameSlots)
+        , _numTimestamps(numTimestamps)
+        , _timestampPeriod(timestampPeriod)
+        , _timestampMask(timestampValidBits >= 64 ? ~uint64_t(0) : (uint64_t(1) << timestampValidBits) - 1)
+    {
+        VkQueryPoolCreateInfo createInfo = {};
+        createInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        createInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        createInfo.queryCount = _numTimestamps * _numFrameSlots;
+
+        if (vkCreateQueryPool(*_device, &createInfo, nullptr, &_queryPool) != VK_SUCCESS)
+            _queryPool = VK_NULL_HANDLE;
+    }
+
+    bool valid() const { return _queryPool != VK_NULL_HANDLE; }
+
+    uint32_t base() const { return static_cast<uint32_t>(_frame % _numFrameSlots) * _numTimestamps; }
+
+    // recorded first in every frame the command graph records, frames vsg
+    // skips do not move on to the next slot
+    void reset(VkCommandBuffer commandBuffer)
+    {
+        ++_frame;
+        vkCmdResetQueryPool(commandBuffer, _queryPool, base(), _numTimestamps);
+    }
+
+    void write(VkCommandBuffer commandBuffer, uint32_t index, VkPipelineStageFlagBits stage) const
+    {
+        vkCmdWriteTimestamp(commandBuffer, stage, _queryPool, base() + index);
+    }
+
+    // GPU time in ms of the oldest frame slot, or a negative value if not
+    // available yet or already collected since the last recorded frame
+    double collect()
+    {
+        const uint64_t frame = _frame;
+        if (frame < _numFrameSlots || frame == _collected)
+            return -1.0;
+
+        _collected = frame;
+
+        const auto slot = static_cast<uint32_t>((frame + 1) % _numFrameSlots) * _numTimestamps;
+
+        std::vector<uint64_t> timestamps(_numTimestamps);
+        if (vkGetQueryPoolResults(*_device, _queryPool, slot, _numTimestamps, timestamps.size() * sizeof(uint64_t), timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS)
+            return -1.0;
+
+        // sum of the begin/end pairs, one pair per render graph. Only the
+        // valid bits count, masking the difference also handles wrap around.
+        uint64_t ticks = 0;
+        for (uint32_t i = 0; i + 1 < _numTimestamps; i += 2)
+            ticks += (timestamps[i + 1] - timestamps[i]) & _timestampMask;
+
+        return static_cast<double>(ticks) * _timestampPeriod * 1e-6;
+    }
+
+protected:
+
+    virtual ~GpuTimer()
+    {
+        if (_queryPool != VK_NULL_HANDLE)
+            vkDestroyQueryPool(*_device, _queryPool, nullptr);
+    }
+
+    vsg::ref_ptr<vsg::Device> _device;
+    VkQueryPool _queryPool{VK_NULL_HANDLE};
+    // results are read back this many frames later, without waiting on the GPU
+    uint32_t _numFrameSlots{0};
+    uint32_t _numTimestamps{0};
+    double _timestampPeriod{1.0};
+    uint64_t _timestampMask{~uint64_t(0)};
+    // advanced by the record traversal, read when the frame ends
+    std::atomic<uint64_t> _frame{0};
+    uint64_t _collected{0};
+};
+
+class ResetTimestamps : public vsg::Inherit<vsg::Command, ResetTimestamps>
+{
+public:
+
+    explicit ResetTimestamps(FrameProfiler::GpuTimer *timer) : _timer(timer) {}
+
+    void record(vsg::CommandBuffer &commandBuffer) const override
+    {
+        _timer->reset(commandBuffer);
+    }
+
+private:
+    vsg::ref_ptr<FrameProfiler::GpuTimer> _timer;
+};
+
+class WriteTimestamp : public vsg::Inherit<vsg::Command, WriteTimestamp>
+{
+public:
+
+    WriteTimestamp(FrameProfiler::GpuTimer *timer, uint32_t index, VkPipelineStageFlagBits stage)
+        : _timer(timer)
+        , _index(index)
+        , _stage(stage)
+    {
+    }
+
+    void record(vsg::CommandBuffer &commandBuffer) const override
+    {
+        _timer->write(commandBuffer, _index, _stage);
+    }
+
+private:
+    vsg::ref_ptr<FrameProfiler::GpuTimer> _timer;
+    uint32_t _index;
+    VkPipelineStageFlagBits _stage;
+};
+
+}
+
+using namespace vsgQt;
+
+void FrameStats::add(double value)
+{
+    _values.push_back(value);
+    while (_values.size() > _window)
+        _values.pop_front();
+}
+
+void FrameStats::clear()
+{
+    _values.clear();
+}
+
+double FrameStats::min() const
+{
+    return _values.empty() ? 0.0 : *std::min_element(_values.begin(), _values.end());
+}
+
+double FrameStats::max() const
+{
+    return _values.empty() ? 0.0 : *std::max_element(_values.begin(), _values.end());
+}
+
+double FrameStats::average() const
+{
+    return _values.empty() ? 0.0 : std::accumulate(_values.begin(), _values.end(), 0.0) / static_cast<double>(_values.size());
+}
+
+double FrameStats::percentile(double p) const
+{
+    if (_values.empty())
+        return 0.0;
+
+    std::vector<double> sorted(_values.begin(), _values.end());
+    const auto n = std::min(sorted.size() - 1, static_cast<size_t>(p * static_cast<double>(sorted.size())));
+    std::nth_element(sorted.begin(), sorted.begin() + n, sorted.end());
+    return sorted[n];
+}
+
+FrameProfiler::FrameProfiler() = default;
+
+FrameProfiler::~FrameProfiler() = default;
+
+const char *FrameProfiler::stageName(Stage stage)
+{
+    switch (stage)
+    {
+    case Advance: return "advance";
+    case Events: return "events";
+    case Update: return "update";
+    case SceneStatistics: return "scenestats";
+    case RecordAndSubmit: return "record";
+    case Present: return "present";
+    case Cpu: return "cpu";
+    case Gpu: return "gpu";
+    case InputLatency: return "latency";
+    default: return "";
+    }
+}
+
+bool FrameProfiler::setupGpuTimer(vsg::Device *device, vsg::Group *commandGraph, uint32_t framesInFlight)
+{
+    // the timestamps of an earlier setup of the same command graph
+    auto &children = commandGraph->getChildren();
+    children.erase(std::remove_if(children.begin(), children.end(), [](const vsg::ref_ptr<vsg::Node> &child) {
+                       return child->cast<ResetTimestamps>() || child->cast<WriteTimestamp>();
+                   }),
+                   children.end());
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(*device->getPhysicalDevice(), &properties);
+
+    if (!properties.limits.timestampComputeAndGraphics)
+    {
+        qCWarning(lc) << "Device does not support timestamp queries, GPU timings are disabled.";
+        return false;
+    }
+
+    uint32_t numRenderGraphs = 0;
+    for (auto &child : children)
+    {
+        if (child->cast<vsg::RenderGraph>())
+            ++numRenderGraphs;
+    }
+
+    if (numRenderGraphs == 0)
+        return false;
+
+    // the queue family the command graph submits to, or the first graphics one
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(*device->getPhysicalDevice(), &queueFamilyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(*device->getPhysicalDevice(), &queueFamilyCount, queueFamilies.data());
+
+    uint32_t timestampValidBits = 0;
+    auto graph = commandGraph->cast<vsg::CommandGraph>();
+    if (graph && graph->queueFamily >= 0 && static_cast<uint32_t>(graph->queueFamily) < queueFamilyCount)
+    {
+        timestampValidBits = queueFamilies[static_cast<uint32_t>(graph->queueFamily)].timestampValidBits;
+    }
+    else
+    {
+        auto itr = std::find_if(queueFamilies.begin(), queueFamilies.end(), [](const VkQueueFamilyProperties &family) { return (family.queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0; });
+        if (itr != queueFamilies.end())
+            timestampValidBits = itr->timestampValidBits;
+    }
+
+    if (timestampValidBits == 0)
+    {
+        qCWarning(lc) << "Queue does not support timestamp queries, GPU timings are disabled.";
+        return false;
+    }
+
+    // a slot is only written again once the frame that used it has finished
+    auto timer = GpuTimer::create(device, std::max(framesInFlight, 1u) + 1, numRenderGraphs * 2, static_cast<double>(properties.limits.timestampPeriod), timestampValidBits);
+    if (!timer->valid())
+        return false;
+
+    // reset the frame's queries outside of any render pass, then bracket each render graph
+    vsg::Group::Children instrumented;
+    instrumented.push_back(ResetTimestamps::create(timer));
+
+    uint32_t index = 0;
+    for (auto &child : children)
+    {
+        if (child->cast<vsg::RenderGraph>())
+        {
+            instrumented.push_back(WriteTimestamp::create(timer, index++, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT));
+            instrumented.push_back(child);
+            instrumented.push_back(WriteTimestamp::create(timer, index++, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT));
+        }
+        else
+        {
+            instrumented.push_back(child);
+        }
+    }
+
+    children = instrumented;
+
+    std::scoped_lock lock(_mutex);
+    _gpuTimer = timer;
+    return true;
+}
+
+void FrameProfiler::releaseGpuTimer()
+{
+    std::scoped_lock lock(_mutex);
+    _gpuTimer = {};
+}
+
+void FrameProfiler::beginFrame()
+{
+    std::scoped_lock lock(_mutex);
+
+    _current.fill(0.0);
+
+    // only frames that handle input have a latency
+    _current[InputLatency] = -1.0;
+}
+
+void FrameProfiler::add(Stage stage, double milliseconds)
+{
+    std::scoped_lock lock(_mutex);
+    _current[stage] += milliseconds;
+}
+
+void FrameProfiler::set(Stage stage, double milliseconds)
+{
+    std::scoped_lock lock(_mutex);
+    _current[stage] = milliseconds;
+}
+
+void FrameProfiler::endFrame()
+{
+    std::scoped_lock lock(_mutex);
+
+    _current[Cpu] = _current[Advance] + _current[Events] + _current[Update] + _current[SceneStatistics] + _current[RecordAndSubmit] + _current[Present];
+
+    // the GPU time belongs to an earlier frame, that is good enough for rolling stats
+    _current[Gpu] = _gpuTimer ? _gpuTimer->collect() : -1.0;
+
+    for (int stage = 0; stage < NumStages; ++stage)
+    {
+        if (_current[stage] >= 0.0)
+            _stats[stage].add(_current[stage]);
+    }
+
+    if (_history.size() < MaxHistory)
+        _history.push_back(_current);
+}
+
+FrameProfiler::Summary FrameProfiler::summary() const
+{
+    std::scoped_lock lock(_mutex);
+
+    Summary summary;
+    summary.numFrames = _history.size();
+
+    for (int stage = 0; stage < NumStages; ++stage)
+    {
+        summary.min[stage] = _stats[stage].min();
+        summary.average[stage] = _stats[stage].average();
+        summary.p99[stage] = _stats[stage].percentile(0.99);
+    }
+
+    return summary;
+}
+
+QString FrameProfiler::summaryText() const
+{
+    const auto s = summary();
+
+    auto text = QString("CPU %1 / %2 / %3 ms").arg(s.min[Cpu], 0, 'f', 2).arg(s.average[Cpu], 0, 'f', 2).arg(s.p99[Cpu], 0, 'f', 2);
+
+    {
+        std::scoped_lock lock(_mutex);
+        if (_stats[Gpu].size() > 0)
+            text += QString("  GPU %1 / %2 / %3 ms").arg(s.min[Gpu], 0, 'f', 2).arg(s.average[Gpu], 0, 'f', 2).arg(s.p99[Gpu], 0, 'f', 2);
+        if (_stats[InputLatency].size() > 0)
+            text += QString("  latency %1 / %2 / %3 ms").arg(s.min[InputLatency], 0, 'f', 2).arg(s.average[InputLatency], 0, 'f', 2).arg(s.p99[InputLatency], 0, 'f', 2);
+    }
+
+    text += QString("  (min/avg/p99, record %1 ms)").arg(s.average[RecordAndSubmit], 0, 'f', 2);
+    return text;
+}
+
+bool FrameProfiler::exportCsv(const QString &filename) const
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+        return false;
+
+    QTextStream out(&file);
+
+    out << "frame";
+    for (int stage = 0; stage < NumStages; ++stage)
+        out << ',' << stageName(static_cast<Stage>(stage)) << "_ms";
+    out << '\n';
+
+    std::scoped_lock lock(_mutex);
+
+    for (size_t frame = 0; frame < _history.size(); ++frame)
+    {
+        out << frame;
+        for (int stage = 0; stage < NumStages; ++stage)
+            out << ',' << _history[frame][stage];
+        out << '\n';
+    }
+
+    return true;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <QString>
+
+#include <vsg/core/ref_ptr.h>
+#include <vsg/nodes/Group.h>
+#include <vsg/vk/Device.h>
+
+#include <array>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+namespace vsgQt {
+
+// Rolling window of timings in milliseconds.
+class FrameStats
+{
+public:
+
+    explicit FrameStats(size_t window = 240) : _window(window) {}
+
+    void add(double value);
+    void clear();
+
+    size_t size() const { return _values.size(); }
+    double min() const;
+    double max() const;
+    double average() const;
+    double percentile(double p) const;
+
+private:
+    size_t _window;
+    std::deque<double> _values;
+};
+
+// Collects CPU timings of the stages of a frame and GPU timings of every
+// render graph, measured with timestamp queries. Input latency is the time
+// from the earliest input event handled by a frame to its present call.
+class FrameProfiler
+{
+public:
+
+    enum Stage
+    {
+        Advance,
+        Events,
+        Update,
+        SceneStatistics,
+        RecordAndSubmit,
+        Present,
+        Cpu,
+        Gpu,
+        InputLatency,
+        NumStages
+    };
+
+    struct Summary
+    {
+        std::array<double, NumStages> min{};
+        std::array<double, NumStages> average{};
+        std::array<double, NumStages> p99{};
+        size_t numFrames{0};
+    };
+
+    FrameProfiler();
+    ~FrameProfiler();
+
+    static const char *stageName(Stage stage);
+
+    // wraps every RenderGraph under commandGraph in timestamp queries, with
+    // query slots for one frame more than framesInFlight. Setting up the same
+    // command graph again replaces the queries of the earlier setup.
+    bool setupGpuTimer(vsg::Device *device, vsg::Group *commandGraph, uint32_t framesInFlight);
+    void releaseGpuTimer();
+
+    void beginFrame();
+    void add(Stage stage, double milliseconds);
+    void set(Stage stage, double milliseconds);
+    void endFrame();
+
+    Summary summary() const;
+    QString summaryText() const;
+    bool exportCsv(const QString &filename) const;
+
+    class GpuTimer;
+
+private:
+
+    mutable std::mutex _mutex;
+    std::array<FrameStats, NumStages> _stats;
+    std::array<double, NumStages> _current{};
+    std::vector<std::array<double, NumStages>> _history;
+    vsg::ref_ptr<GpuTimer> _gpuTimer;
+};
+
+}
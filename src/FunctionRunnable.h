@@ -0,0 +1,29 @@
+#pragma once
+
+#include <QRunnable>
+
+#include <functional>
+
+namespace vsgQt {
+
+// Runs a function on a QThreadPool, deleted by the pool once it has run.
+class FunctionRunnable : public QRunnable
+{
+public:
+
+    explicit FunctionRunnable(std::function<void()> function)
+        : _function(std::move(function))
+    {
+        setAutoDelete(true);
+    }
+
+    void run() override
+    {
+        _function();
+    }
+
+private:
+    std::function<void()> _function;
+};
+
+}
@@ -0,0 +1,381 @@
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+
+#include "LodGenerator.h"
+#include "BinaryCache.h"
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFileInfo>
+#include <QLoggingCategory>
+#include <QTemporaryFile>
+
+#include <vsg/all.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <unordered_map>
+
+namespace {
+static QLoggingCategory lc("lodgenerator");
+
+// part of the cache key, raised when the same settings build other hierarchies
+constexpr int CacheVersion = 2;
+
+using Triangle = std::array<uint32_t, 3>;
+using Triangles = std::vector<Triangle>;
+
+class MeshSource
+{
+public:
+
+    MeshSource(const vsg::VertexIndexDraw &draw, const vsg::vec3Array &positions)
+        : _draw(draw)
+        , _positions(positions)
+    {
+    }
+
+    const vsg::vec3 &position(uint32_t index) const
+    {
+        return _positions[static_cast<size_t>(static_cast<int64_t>(index) + _draw.vertexOffset)];
+    }
+
+    vsg::vec3 centroid(const Triangle &triangle) const
+    {
+        return (position(triangle[0]) + position(triangle[1]) + position(triangle[2])) / 3.0f;
+    }
+
+    vsg::box bounds(const Triangles &triangles) const
+    {
+        vsg::box box;
+        for (auto &triangle : triangles)
+        {
+            for (auto index : triangle)
+                box.add(position(index));
+        }
+        return box;
+    }
+
+    // triangles of the clustered mesh, every vertex moves to the first vertex of its grid cell
+    Triangles simplify(const Triangles &triangles, float cellSize) const
+    {
+        struct CellHash
+        {
+            size_t operator()(const std::array<int32_t, 3> &cell) const
+            {
+                return (static_cast<size_t>(cell[0]) * 73856093u) ^ (static_cast<size_t>(cell[1]) * 19349663u) ^ (static_cast<size_t>(cell[2]) * 83492791u);
+            }
+        };
+
+        std::unordered_map<std::array<int32_t, 3>, uint32_t, CellHash> representatives;
+        std::unordered_map<uint32_t, uint32_t> remapped;
+
+        auto remap = [&](uint32_t index) {
+            if (auto itr = remapped.find(index); itr != remapped.end())
+                return itr->second;
+
+            const auto &p = position(index);
+            const std::array<int32_t, 3> cell{
+                static_cast<int32_t>(std::floor(p.x / cellSize)),
+                static_cast<int32_t>(std::floor(p.y / cellSize)),
+                static_cast<int32_t>(std::floor(p.z / cellSize))};
+
+            const auto representative = representatives.emplace(cell, index).first->second;
+            remapped[index] = representative;
+            return representative;
+        };
+
+        Triangles simplified;
+        for (auto &triangle : triangles)
+        {
+            const Triangle clustered{remap(triangle[0]), remap(triangle[1]), remap(triangle[2])};
+
+            // triangles collapsed into a line or a point disappear
+            if (clustered[0] != clustered[1] && clustered[1] != clustered[2] && clustered[0] != clustered[2])
+                simplified.push_back(clustered);
+        }
+
+        return simplified;
+    }
+
+    vsg::ref_ptr<vsg::VertexIndexDraw> createDraw(const Triangles &triangles) const
+    {
+        vsg::ref_ptr<vsg::Data> indices;
+        if (_draw.indices->cast<vsg::ushortArray>())
+        {
+            auto array = vsg::ushortArray::create(static_cast<uint32_t>(triangles.size() * 3));
+            auto itr = array->begin();
+            for (auto &triangle : triangles)
+            {
+                for (auto index : triangle)
+                    *itr++ = static_cast<uint16_t>(index);
+            }
+            indices = array;
+        }
+        else
+        {
+            auto array = vsg::uintArray::create(static_cast<uint32_t>(triangles.size() * 3));
+            auto itr = array->begin();
+            for (auto &triangle : triangles)
+            {
+                for (auto index : triangle)
+                    *itr++ = index;
+            }
+            indices = array;
+        }
+
+        auto draw = vsg::VertexIndexDraw::create();
+        draw->arrays = _draw.arrays;
+        draw->indices = indices;
+        draw->indexCount = static_cast<uint32_t>(triangles.size() * 3);
+        draw->instanceCount = _draw.instanceCount;
+        draw->firstIndex = 0;
+        draw->vertexOffset = _draw.vertexOffset;
+        draw->firstInstance = _draw.firstInstance;
+        return draw;
+    }
+
+private:
+
+    const vsg::VertexIndexDraw &_draw;
+    const vsg::vec3Array &_positions;
+};
+
+bool readTriangles(const vsg::VertexIndexDraw &draw, Triangles &triangles)
+{
+    if (!draw.indices || draw.indexCount % 3 != 0)
+        return false;
+
+    auto read = [&](auto &indices) {
+        if (draw.firstIndex + draw.indexCount > indices.valueCount())
+            return false;
+
+        triangles.reserve(draw.indexCount / 3);
+        for (uint32_t i = draw.firstIndex; i < draw.firstIndex + draw.indexCount; i += 3)
+            triangles.push_back({static_cast<uint32_t>(indices[i]), static_cast<uint32_t>(indices[i + 1]), static_cast<uint32_t>(indices[i + 2])});
+        return true;
+    };
+
+    if (auto indices = draw.indices.cast<vsg::ushortArray>())
+        return read(*indices);
+    if (auto indices = draw.indices.cast<vsg::uintArray>())
+        return read(*indices);
+
+    return false;
+}
+
+class BuildHierarchy
+{
+public:
+
+    BuildHierarchy(const vsgQt::LodGenerator::Settings &settings, const MeshSource &mesh)
+        : _settings(settings)
+        , _mesh(mesh)
+    {
+        // a clustered chunk is off by up to a cell, i.e. diagonal / resolution.
+        // vsg's ratio is the projected radius over half the screen height, so
+        // the bounding sphere, diagonal in diameter, covers screenHeight *
+        // ratio pixels and the error stays below maxErrorPixels for ratios
+        // below maxErrorPixels * resolution / screenHeight.
+        _switchRatio = _settings.maxErrorPixels * static_cast<double>(_settings.resolution) / _settings.screenHeight;
+    }
+
+    vsg::ref_ptr<vsg::Node> build(const Triangles &triangles, uint32_t depth) const
+    {
+        const auto bounds = _mesh.bounds(triangles);
+        const auto diagonal = vsg::length(bounds.max - bounds.min);
+
+        vsg::ref_ptr<vsg::Node> detail;
+        if (triangles.size() <= _settings.leafTriangles || depth >= _settings.maxDepth || diagonal <= 0.0f)
+        {
+            detail = _mesh.createDraw(triangles);
+        }
+        else
+        {
+            // split by centroid into octants, empty ones are dropped
+            const auto center = (bounds.min + bounds.max) * 0.5f;
+            std::array<Triangles, 8> octants;
+            for (auto &triangle : triangles)
+            {
+                const auto c = _mesh.centroid(triangle);
+                const size_t octant = (c.x > center.x ? 1 : 0) | (c.y > center.y ? 2 : 0) | (c.z > center.z ? 4 : 0);
+                octants[octant].push_back(triangle);
+            }
+
+            auto group = vsg::Group::create();
+            for (auto &octant : octants)
+            {
+                if (octant.size() == triangles.size())
+                    return _mesh.createDraw(triangles);
+
+                if (!octant.empty())
+                    group->addChild(build(octant, depth + 1));
+            }
+            detail = group;
+        }
+
+        const auto simplified = _mesh.simplify(triangles, diagonal / static_cast<float>(_settings.resolution));
+        if (diagonal <= 0.0f || simplified.empty() || simplified.size() * 2 > triangles.size())
+            return detail;
+
+        auto lod = vsg::LOD::create();
+        lod->bound = vsg::dsphere(vsg::dvec3((bounds.min + bounds.max) * 0.5f), static_cast<double>(diagonal) * 0.5);
+        lod->addChild(vsg::LOD::Child{_switchRatio, detail});
+        lod->addChild(vsg::LOD::Child{0.0, _mesh.createDraw(simplified)});
+        return lod;
+    }
+
+private:
+
+    const vsgQt::LodGenerator::Settings &_settings;
+    const MeshSource &_mesh;
+    double _switchRatio{0.0};
+};
+
+class ReplaceDenseMeshes : public vsg::Visitor
+{
+public:
+
+    explicit ReplaceDenseMeshes(const vsgQt::LodGenerator::Settings &settings) : _settings(settings) {}
+
+    void apply(vsg::Object &object) override
+    {
+        object.traverse(*this);
+    }
+
+    void apply(vsg::Group &group) override
+    {
+        for (auto &child : group.getChildren())
+        {
+            if (auto draw = child->cast<vsg::VertexIndexDraw>())
+            {
+                if (auto replacement = process(*draw))
+                {
+                    child = replacement;
+                    ++replaced;
+                }
+            }
+            else
+            {
+                child->accept(*this);
+            }
+        }
+    }
+
+    uint32_t replaced{0};
+
+private:
+
+    vsg::ref_ptr<vsg::Node> process(const vsg::VertexIndexDraw &draw) const
+    {
+        // the vertices of an instanced draw do not bound its instances
+        if (draw.arrays.empty() || draw.instanceCount != 1 || draw.indexCount / 3 < _settings.minTriangles)
+            return {};
+
+        auto positions = draw.arrays.front().cast<vsg::vec3Array>();
+        if (!positions)
+            return {};
+
+        Triangles triangles;
+        if (!readTriangles(draw, triangles))
+            return {};
+
+        MeshSource mesh(draw, *positions);
+        return BuildHierarchy(_settings, mesh).build(triangles, 0);
+    }
+
+    const vsgQt::LodGenerator::Settings &_settings;
+};
+}
+
+using namespace vsgQt;
+
+void LodGenerator::setCacheDirectory(const QString &directory)
+{
+    _cacheDirectory = directory;
+    if (!_cacheDirectory.isEmpty())
+        QDir().mkpath(_cacheDirectory);
+}
+
+void LodGenerator::setReadFunction(ReadFunction read)
+{
+    _read = std::move(read);
+}
+
+uint32_t LodGenerator::apply(vsg::Node *node) const
+{
+    ReplaceDenseMeshes replace(_settings);
+    node->accept(replace);
+    return replace.replaced;
+}
+
+QString LodGenerator::cacheFilename(const QString &filename) const
+{
+    if (_cacheDirectory.isEmpty())
+        return {};
+
+    // a changed source file or other settings give another cache entry
+    const QFileInfo info(filename);
+    const auto key = QString("%1|%2|%3|%4 %5 %6 %7 %8 %9|%10")
+        .arg(info.absoluteFilePath())
+        .arg(info.size())
+        .arg(info.lastModified().toMSecsSinceEpoch())
+        .arg(_settings.minTriangles)
+        .arg(_settings.leafTriangles)
+        .arg(_settings.maxDepth)
+        .arg(_settings.resolution)
+        .arg(_settings.maxErrorPixels)
+        .arg(_settings.screenHeight)
+        .arg(CacheVersion);
+
+    const auto hash = QCryptographicHash::hash(key.toUtf8(), QCryptographicHash::Sha1).toHex();
+    return QDir(_cacheDirectory).filePath(QString::fromLatin1(hash) + ".vsgb");
+}
+
+vsg::ref_ptr<vsg::Node> LodGenerator::read(const QString &filename, vsg::ref_ptr<const vsg::Options> options) const
+{
+    const auto cached = cacheFilename(filename);
+    if (!cached.isEmpty() && QFileInfo::exists(cached))
+    {
+        if (auto node = BinaryCache::readMapped(cached, options).cast<vsg::Node>())
+        {
+            qCDebug(lc) << "Read levels of detail of" << filename << "from" << cached;
+            return node;
+        }
+    }
+
+    auto node = _read ? _read(filename, options) : vsg::read_cast<vsg::Node>(filename.toStdString(), options);
+    if (!node)
+        return {};
+
+    const auto replaced = apply(node);
+    qCDebug(lc) << "Built levels of detail for" << replaced << "meshes of" << filename;
+
+    if (replaced > 0 && !cached.isEmpty())
+    {
+        // written next to the entry and renamed, so readers never map a
+        // partial file. Views loading the same model each write their own.
+        QTemporaryFile partial(cached + ".XXXXXX.part.vsgb");
+        partial.setAutoRemove(false);
+
+        bool written = false;
+        if (partial.open())
+        {
+            partial.close();
+            written = vsg::write(node, partial.fileName().toStdString());
+        }
+
+        if (!written || !QFile::rename(partial.fileName(), cached))
+        {
+            QFile::remove(partial.fileName());
+
+            // another load of the same model may have finished first
+            if (!QFileInfo::exists(cached))
+                qCWarning(lc) << "Could not write" << cached;
+        }
+    }
+
+    return node;
+}
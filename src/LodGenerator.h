@@ -0,0 +1,70 @@
+#pragma once
+
+#include <QString>
+
+#include <vsg/core/ref_ptr.h>
+#include <vsg/io/Options.h>
+#include <vsg/nodes/Node.h>
+
+#include <cstdint>
+#include <functional>
+
+namespace vsgQt {
+
+// Replaces dense meshes by a spatial hierarchy of vsg::LOD nodes. A mesh is
+// split into octants until a chunk is small enough, and every level gets a
+// simplified version, made by vertex clustering, that is shown while the
+// clustering error stays below maxErrorPixels on screen.
+//
+// Simplified meshes only get new index arrays, they share the vertex arrays
+// of the original mesh. Meshes are expected to be indexed triangle lists of
+// vsg::VertexIndexDraw with vec3 positions in the first array, others are
+// left alone.
+class LodGenerator
+{
+public:
+
+    struct Settings
+    {
+        // meshes with fewer triangles are left as they are
+        uint32_t minTriangles{20000};
+        // chunks with fewer triangles are not split any further
+        uint32_t leafTriangles{16384};
+        uint32_t maxDepth{6};
+        // clustering grid cells along the diagonal of a chunk
+        uint32_t resolution{32};
+        double maxErrorPixels{2.0};
+        // the screen height the switch distances are computed for
+        double screenHeight{1080.0};
+    };
+
+    using ReadFunction = std::function<vsg::ref_ptr<vsg::Node>(const QString &filename, vsg::ref_ptr<const vsg::Options> options)>;
+
+    LodGenerator() = default;
+    explicit LodGenerator(const Settings &settings) : _settings(settings) {}
+
+    const Settings &settings() const { return _settings; }
+
+    // cache of processed models, none when empty
+    void setCacheDirectory(const QString &directory);
+
+    // reads the source models on a cache miss, defaults to vsg::read_cast
+    void setReadFunction(ReadFunction read);
+
+    // returns the number of meshes replaced under node
+    uint32_t apply(vsg::Node *node) const;
+
+    // reads filename and applies the generator, or reads the result of an
+    // earlier run from the cache
+    vsg::ref_ptr<vsg::Node> read(const QString &filename, vsg::ref_ptr<const vsg::Options> options = {}) const;
+
+private:
+
+    QString cacheFilename(const QString &filename) const;
+
+    Settings _settings;
+    QString _cacheDirectory;
+    ReadFunction _read;
+};
+
+}
@@ -2,31 +2,287 @@
 #include "ui_MainWindow.h"
 #include "VulkanWindow.h"
 
+#include <QActionGroup>
 #include <QFileDialog>
 #include <QColorDialog>
+#include <QGridLayout>
+#include <QLabel>
+#include <QMessageBox>
+#include <QProgressBar>
+#include <QSignalBlocker>
+#include <QToolButton>
 
-MainWindow::MainWindow(QWidget *parent)
+#include <algorithm>
+
+MainWindow::MainWindow(int numViews, QWidget *parent)
     : QMainWindow(parent)
     , ui(new Ui::MainWindow)
+    , loadProgress(new QProgressBar(this))
+    , cancelLoad(new QToolButton(this))
+    , frameProfile(new QLabel(this))
+    , deviceMemory(new QLabel(this))
+    , captureStatus(new QLabel(this))
+    , sceneStatistics(new QLabel(this))
 {
     ui->setupUi(this);
 
-    auto window = new VulkanWindow();
+    loadProgress->setRange(0, 100);
+    loadProgress->setMaximumWidth(200);
+    loadProgress->hide();
+    ui->statusbar->addPermanentWidget(loadProgress);
+
+    cancelLoad->setText(tr("Cancel"));
+    cancelLoad->hide();
+    ui->statusbar->addPermanentWidget(cancelLoad);
+    ui->statusbar->addPermanentWidget(frameProfile);
+    ui->statusbar->addPermanentWidget(deviceMemory);
+    captureStatus->hide();
+    ui->statusbar->addPermanentWidget(captureStatus);
+    sceneStatistics->hide();
+    ui->statusbar->addPermanentWidget(sceneStatistics);
+
+    window = new VulkanWindow();
+    views.append(window);
 
-    auto widget = QWidget::createWindowContainer(window, this);
-    setCentralWidget(widget);
+    if (numViews < 2)
+    {
+        auto widget = QWidget::createWindowContainer(window, this);
+        setCentralWidget(widget);
+    }
+    else
+    {
+        // the other views share the device, scene and frame loop of the main one
+        window->setViewDirection(VulkanWindow::ViewDirection::Perspective);
+
+        auto grid = new QWidget(this);
+        auto layout = new QGridLayout(grid);
+        layout->setContentsMargins(0, 0, 0, 0);
+        layout->setSpacing(1);
+
+        const VulkanWindow::ViewDirection directions[] = {
+            VulkanWindow::ViewDirection::Top,
+            VulkanWindow::ViewDirection::Front,
+            VulkanWindow::ViewDirection::Side
+        };
+
+        // side by side up to 3 views, 4 in a 2x2 grid with the perspective one last
+        const int numExtraViews = std::min(numViews, 4) - 1;
+        const int columns = numViews < 4 ? numViews : 2;
+        for (int i = 0; i < numExtraViews; ++i)
+        {
+            auto view = new VulkanWindow(window);
+            view->setViewDirection(directions[i]);
+            views.append(view);
+            layout->addWidget(QWidget::createWindowContainer(view, grid), i / columns, i % columns);
+        }
+
+        layout->addWidget(QWidget::createWindowContainer(window, grid), numExtraViews / columns, numExtraViews % columns);
+        setCentralWidget(grid);
+    }
 
     connect(ui->actionOpen, &QAction::triggered, this, [=]() {
-        if (const auto filename = QFileDialog::getOpenFileName(this, tr("Open file"), nullptr, "VSG files (*.vsgt);;All files (*.*)"); !filename.isEmpty())
+        if (const auto filename = QFileDialog::getOpenFileName(this, tr("Open file"), nullptr, "VSG files (*.vsgt *.vsgb);;All files (*.*)"); !filename.isEmpty())
             window->loadFile(filename);
     });
 
+    connect(ui->actionExportFrameProfile, &QAction::triggered, this, [=]() {
+        if (const auto filename = QFileDialog::getSaveFileName(this, tr("Export frame profile"), nullptr, "CSV files (*.csv)"); !filename.isEmpty())
+        {
+            if (!window->exportFrameProfile(filename))
+                QMessageBox::warning(this, tr("Export frame profile"), tr("Could not write %1").arg(filename));
+        }
+    });
+
+    connect(ui->actionRecordFrames, &QAction::toggled, this, [=](bool checked) {
+        if (!checked)
+        {
+            captureStatus->setText(tr("Writing frames"));
+            window->stopCapture();
+            return;
+        }
+
+        const auto directory = QFileDialog::getExistingDirectory(this, tr("Record frames to"));
+        if (directory.isEmpty() || !window->startCapture(directory, captureFormat))
+        {
+            if (!directory.isEmpty())
+                QMessageBox::warning(this, tr("Record frames"), tr("Could not record to %1").arg(directory));
+
+            QSignalBlocker blocker(ui->actionRecordFrames);
+            ui->actionRecordFrames->setChecked(false);
+            return;
+        }
+
+        captureStatus->setText(tr("Recording"));
+        captureStatus->show();
+    });
+
+    connect(window, &VulkanWindow::captureFinished, this, [=]() {
+        const auto stats = window->captureStats();
+        captureStatus->hide();
+        ui->statusbar->showMessage(tr("Recorded %1 frames, %2 dropped").arg(stats.written).arg(stats.dropped), 5000);
+    });
+
+    connect(window, &VulkanWindow::frameProfileUpdated, frameProfile, &QLabel::setText);
+
+    // only rendered frames are recorded, with on demand rendering that is when the scene changes
+    connect(window, &VulkanWindow::frameProfileUpdated, this, [=]() {
+        if (window->isCapturing())
+        {
+            const auto stats = window->captureStats();
+            captureStatus->setText(tr("Recording %1 frames, %2 dropped").arg(stats.captured).arg(stats.dropped));
+        }
+    });
+
+    // the memory readout follows the profile updates, twice a second while rendering
+    connect(window, &VulkanWindow::frameProfileUpdated, this, [=]() {
+        deviceMemory->setText(tr("GPU %1 / %2 MB").arg(window->deviceMemoryUsage() >> 20).arg(window->deviceMemoryBudget() >> 20));
+    });
+
+    ui->actionSceneStatistics->setChecked(window->isSceneStatisticsEnabled());
+    connect(ui->actionSceneStatistics, &QAction::toggled, this, [=](bool checked) {
+        window->setSceneStatisticsEnabled(checked);
+        sceneStatistics->setVisible(checked);
+        sceneStatistics->clear();
+    });
+
+    // the counters of the last frame, with the profile updates
+    connect(window, &VulkanWindow::frameProfileUpdated, this, [=]() {
+        if (!window->isSceneStatisticsEnabled())
+            return;
+
+        const auto stats = window->sceneStatistics();
+        sceneStatistics->setText(tr("%1 draws, %2 primitives, %3 pipeline / %4 descriptor binds, %5 culled")
+            .arg(stats.drawCalls)
+            .arg(stats.indexedPrimitives)
+            .arg(stats.pipelineBinds)
+            .arg(stats.descriptorBinds)
+            .arg(stats.culledNodes));
+    });
+
+    connect(ui->actionFrameAll, &QAction::triggered, this, [=]() {
+        for (auto view : views)
+            view->frameAll();
+    });
+
+    // the selection is what was picked last, in whichever view
+    connect(ui->actionFrameSelection, &QAction::triggered, this, [=]() {
+        for (auto view : views)
+            view->frameSelection();
+    });
+
+    // double clicking a view picks what is under the cursor
+    for (auto view : views)
+    {
+        connect(view, &VulkanWindow::picked, this, [=](int, const VulkanWindow::PickResult &result) {
+            if (!result.hit)
+            {
+                ui->statusbar->showMessage(tr("Nothing picked"), 5000);
+                return;
+            }
+
+            ui->statusbar->showMessage(tr("Picked triangle %1 at (%2, %3, %4)")
+                .arg(result.primitiveIndex)
+                .arg(result.worldPosition.x())
+                .arg(result.worldPosition.y())
+                .arg(result.worldPosition.z()), 5000);
+        });
+    }
+
+    connect(ui->actionMemoryUsage, &QAction::triggered, this, [=]() {
+        auto megabytes = [](qint64 bytes) { return QString::number(static_cast<double>(bytes) / (1 << 20), 'f', 1); };
+
+        QString text = tr("Device memory: %1 of %2 MB\n\n").arg(megabytes(window->deviceMemoryUsage())).arg(megabytes(window->deviceMemoryBudget()));
+        for (const auto &model : window->modelMemory())
+        {
+            text += tr("%1\n  vertices %2 MB, indices %3 MB, textures %4 MB, descriptors %5 MB\n")
+                .arg(model.name)
+                .arg(megabytes(model.vertexBytes))
+                .arg(megabytes(model.indexBytes))
+                .arg(megabytes(model.textureBytes))
+                .arg(megabytes(model.descriptorBytes));
+        }
+
+        QMessageBox::information(this, tr("Memory usage"), text);
+    });
+
+    connect(cancelLoad, &QToolButton::clicked, window, &VulkanWindow::cancelAllLoads);
+
+    connect(window, &VulkanWindow::loadStarted, this, [=](int id, const QString &filename) {
+        pendingLoads.insert(id);
+        loadProgress->setValue(0);
+        loadProgress->show();
+        cancelLoad->show();
+        ui->statusbar->showMessage(tr("Loading %1...").arg(filename));
+    });
+
+    connect(window, &VulkanWindow::loadProgress, this, [=](int id, int percent) {
+        // with several loads in flight the bar follows the most recent one
+        if (pendingLoads.contains(id))
+            loadProgress->setValue(percent);
+    });
+
+    connect(window, &VulkanWindow::loadFinished, this, [=](int id, const QString &filename, bool success) {
+        pendingLoads.remove(id);
+        if (pendingLoads.isEmpty())
+        {
+            loadProgress->hide();
+            cancelLoad->hide();
+        }
+
+        ui->statusbar->showMessage(success ? tr("Loaded %1").arg(filename) : tr("Failed to load %1").arg(filename), 5000);
+    });
+
     connect(ui->actionClearColor, &QAction::triggered, this, [=]() {
         if (const auto color = QColorDialog::getColor(window->clearColor(), this, tr("Choose background color")); color.isValid())
         {
-            window->setClearColor(color);
+            for (auto view : views)
+                view->setClearColor(color);
         }
     });
+
+    ui->actionContinuousRendering->setChecked(window->renderMode() == VulkanWindow::RenderMode::Continuous);
+    connect(ui->actionContinuousRendering, &QAction::toggled, this, [=](bool checked) {
+        window->setRenderMode(checked ? VulkanWindow::RenderMode::Continuous : VulkanWindow::RenderMode::OnDemand);
+    });
+
+    ui->actionLevelsOfDetail->setChecked(window->isLevelOfDetailEnabled());
+    connect(ui->actionLevelsOfDetail, &QAction::toggled, window, &VulkanWindow::setLevelOfDetailEnabled);
+
+    ui->actionOptimizeScene->setChecked(window->isSceneOptimizationEnabled());
+    connect(ui->actionOptimizeScene, &QAction::toggled, window, &VulkanWindow::setSceneOptimizationEnabled);
+
+    ui->actionAutoInstancing->setChecked(window->isAutoInstancingEnabled());
+    connect(ui->actionAutoInstancing, &QAction::toggled, window, &VulkanWindow::setAutoInstancingEnabled);
+
+    ui->actionCompressTextures->setChecked(window->isTextureCompressionEnabled());
+    connect(ui->actionCompressTextures, &QAction::toggled, window, &VulkanWindow::setTextureCompressionEnabled);
+
+    // the present mode trades tearing and power for input latency, all views share it
+    auto presentModeMenu = ui->menuCustomize->addMenu(tr("Present mode"));
+    auto presentModeGroup = new QActionGroup(this);
+
+    const std::pair<VulkanWindow::PresentMode, QString> presentModes[] = {
+        {VulkanWindow::PresentMode::Fifo, tr("FIFO (vsync)")},
+        {VulkanWindow::PresentMode::Mailbox, tr("Mailbox")},
+        {VulkanWindow::PresentMode::Immediate, tr("Immediate (tearing)")}
+    };
+
+    for (const auto &[mode, text] : presentModes)
+    {
+        auto action = presentModeMenu->addAction(text);
+        action->setCheckable(true);
+        action->setChecked(window->presentMode() == mode);
+        presentModeGroup->addAction(action);
+        presentModeActions.insert(mode, action);
+
+        connect(action, &QAction::triggered, this, [=]() { setPresentMode(mode); });
+    }
+
+    // a mode the surface lacks shows as the FIFO it falls back to
+    connect(presentModeMenu, &QMenu::aboutToShow, this, [=]() {
+        if (auto action = presentModeActions.value(window->presentMode()))
+            action->setChecked(true);
+    });
 }
 
 MainWindow::~MainWindow()
@@ -34,3 +290,28 @@ MainWindow::~MainWindow()
     delete ui;
 }
 
+VulkanWindow *MainWindow::vulkanWindow() const
+{
+    return window;
+}
+
+void MainWindow::setPresentMode(VulkanWindow::PresentMode mode)
+{
+    for (auto view : views)
+        view->setPresentMode(mode);
+
+    if (auto action = presentModeActions.value(window->presentMode()))
+        action->setChecked(true);
+}
+
+void MainWindow::setFramesInFlight(int count)
+{
+    for (auto view : views)
+        view->setFramesInFlight(count);
+}
+
+void MainWindow::setCaptureFormat(VulkanWindow::CaptureFormat format)
+{
+    captureFormat = format;
+}
+
@@ -1,6 +1,15 @@
 #pragma once
 
+#include <QList>
 #include <QMainWindow>
+#include <QMap>
+#include <QSet>
+
+#include "VulkanWindow.h"
+
+class QLabel;
+class QProgressBar;
+class QToolButton;
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class MainWindow; }
@@ -11,9 +20,30 @@ class MainWindow : public QMainWindow
     Q_OBJECT
 
 public:
-    MainWindow(QWidget *parent = nullptr);
+    // numViews from 1 to 4, the perspective view with the top, front and side views of one shared scene
+    explicit MainWindow(int numViews = 1, QWidget *parent = nullptr);
     ~MainWindow();
 
+    VulkanWindow *vulkanWindow() const;
+
+    // apply to all views
+    void setPresentMode(VulkanWindow::PresentMode mode);
+    void setFramesInFlight(int count);
+
+    // of the frames File > Record frames writes
+    void setCaptureFormat(VulkanWindow::CaptureFormat format);
+
 private:
     Ui::MainWindow *ui;
+    VulkanWindow *window;
+    QList<VulkanWindow *> views;
+    QProgressBar *loadProgress;
+    QToolButton *cancelLoad;
+    QLabel *frameProfile;
+    QLabel *deviceMemory;
+    QLabel *captureStatus;
+    QLabel *sceneStatistics;
+    VulkanWindow::CaptureFormat captureFormat{VulkanWindow::CaptureFormat::Png};
+    QSet<int> pendingLoads;
+    QMap<VulkanWindow::PresentMode, QAction *> presentModeActions;
 };
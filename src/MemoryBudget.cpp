@@ -0,0 +1,301 @@
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+
+#include "MemoryBudget.h"
+
+#include <vsg/all.h>
+
+#include <algorithm>
+#include <cstring>
+#include <set>
+
+namespace {
+
+// headroom left for swapchains, staging and other allocations outside the models
+constexpr double BudgetFraction = 0.9;
+
+class EstimateMemory : public vsg::Visitor
+{
+public:
+
+    void apply(vsg::Object &object) override
+    {
+        if (auto sampler = object.cast<vsg::Sampler>(); sampler && sampler->maxLod > 0.0f)
+            mipmapped = true;
+
+        object.traverse(*this);
+    }
+
+    void apply(vsg::StateGroup &stateGroup) override
+    {
+        for (auto &command : stateGroup.getStateCommands())
+            command->accept(*this);
+
+        stateGroup.traverse(*this);
+    }
+
+    void apply(vsg::VertexIndexDraw &draw) override
+    {
+        addArrays(draw.arrays);
+        addIndices(draw.indices);
+    }
+
+    void apply(vsg::Geometry &geometry) override
+    {
+        addArrays(geometry.arrays);
+        addIndices(geometry.indices);
+
+        for (auto &command : geometry.commands)
+            command->accept(*this);
+    }
+
+    void apply(vsg::BindVertexBuffers &bindVertexBuffers) override
+    {
+        addArrays(bindVertexBuffers.arrays);
+    }
+
+    void apply(vsg::BindIndexBuffer &bindIndexBuffer) override
+    {
+        addIndices(bindIndexBuffer.indices);
+    }
+
+    // data outside of draws are images or uniform and storage buffers
+    void apply(vsg::Data &data) override
+    {
+        if (!visited(&data))
+            return;
+
+        if (data.height() > 1 || data.depth() > 1)
+            textures += data.dataSize();
+        else
+            usage.descriptor += data.dataSize();
+    }
+
+    vsgQt::MemoryUsage result() const
+    {
+        auto total = usage;
+        total.texture = mipmapped ? textures + textures / 3 : textures;
+        return total;
+    }
+
+private:
+
+    bool visited(const vsg::Data *data)
+    {
+        return data && seen.insert(data).second;
+    }
+
+    void addArrays(const vsg::DataList &arrays)
+    {
+        for (auto &array : arrays)
+        {
+            if (visited(array))
+                usage.vertex += array->dataSize();
+        }
+    }
+
+    void addIndices(const vsg::ref_ptr<vsg::Data> &indices)
+    {
+        if (visited(indices))
+            usage.index += indices->dataSize();
+    }
+
+    vsgQt::MemoryUsage usage;
+    uint64_t textures{0};
+    bool mipmapped{false};
+    std::set<const vsg::Data *> seen;
+};
+
+class DropMipmaps : public vsg::Visitor
+{
+public:
+
+    void apply(vsg::Object &object) override
+    {
+        if (auto sampler = object.cast<vsg::Sampler>(); sampler && sampler->maxLod > 0.0f)
+        {
+            sampler->maxLod = 0.0f;
+            dropped = true;
+        }
+
+        object.traverse(*this);
+    }
+
+    void apply(vsg::StateGroup &stateGroup) override
+    {
+        for (auto &command : stateGroup.getStateCommands())
+            command->accept(*this);
+
+        stateGroup.traverse(*this);
+    }
+
+    bool dropped{false};
+};
+
+}
+
+vsgQt::MemoryUsage vsgQt::estimateMemory(vsg::Node *node)
+{
+    EstimateMemory estimate;
+    node->accept(estimate);
+    return estimate.result();
+}
+
+bool vsgQt::dropMipmaps(vsg::Node *node)
+{
+    DropMipmaps drop;
+    node->accept(drop);
+    return drop.dropped;
+}
+
+using namespace vsgQt;
+
+void MemoryBudget::setup(VkInstance instance, VkPhysicalDevice physicalDevice)
+{
+    std::scoped_lock lock(_mutex);
+
+    _physicalDevice = physicalDevice;
+    _getMemoryProperties2 = reinterpret_cast<PFN_vkGetPhysicalDeviceMemoryProperties2>(vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceMemoryProperties2"));
+
+    uint32_t count = 0;
+    vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &count, nullptr);
+    std::vector<VkExtensionProperties> extensions(count);
+    vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &count, extensions.data());
+
+    _driverBudget = _getMemoryProperties2 && std::any_of(extensions.begin(), extensions.end(), [](const VkExtensionProperties &extension) {
+        return std::strcmp(extension.extensionName, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0;
+    });
+}
+
+void MemoryBudget::setLimit(uint64_t bytes)
+{
+    std::scoped_lock lock(_mutex);
+    _limit = bytes;
+}
+
+uint64_t MemoryBudget::limit() const
+{
+    std::scoped_lock lock(_mutex);
+    return _limit;
+}
+
+bool MemoryBudget::hasDriverBudget() const
+{
+    std::scoped_lock lock(_mutex);
+    return _driverBudget;
+}
+
+void MemoryBudget::query(uint64_t &budget, uint64_t &usage) const
+{
+    std::scoped_lock lock(_mutex);
+    queryLocked(budget, usage);
+}
+
+void MemoryBudget::queryLocked(uint64_t &budget, uint64_t &usage) const
+{
+    budget = 0;
+    usage = 0;
+
+    if (_physicalDevice == VK_NULL_HANDLE)
+        return;
+
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties = {};
+    budgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+    VkPhysicalDeviceMemoryProperties2 properties = {};
+    properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+    properties.pNext = _driverBudget ? &budgetProperties : nullptr;
+
+    if (_getMemoryProperties2)
+        _getMemoryProperties2(_physicalDevice, &properties);
+    else
+        vkGetPhysicalDeviceMemoryProperties(_physicalDevice, &properties.memoryProperties);
+
+    const auto &heaps = properties.memoryProperties;
+    for (uint32_t i = 0; i < heaps.memoryHeapCount; ++i)
+    {
+        if (!(heaps.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT))
+            continue;
+
+        budget += _driverBudget ? budgetProperties.heapBudget[i] : heaps.memoryHeaps[i].size;
+        usage += _driverBudget ? budgetProperties.heapUsage[i] : 0;
+    }
+
+    if (!_driverBudget)
+    {
+        for (auto &[node, model] : _models)
+            usage += model.usage.total();
+    }
+
+    if (_limit > 0)
+        budget = std::min(budget, _limit);
+}
+
+bool MemoryBudget::reserve(vsg::ref_ptr<const vsg::Node> node, const MemoryUsage &usage)
+{
+    std::scoped_lock lock(_mutex);
+
+    uint64_t budget = 0, current = 0;
+    queryLocked(budget, current);
+
+    // the driver only sees memory once it is allocated, reservations not yet compiled count as well
+    if (_driverBudget)
+    {
+        for (auto pending : _pending)
+            current += _models.at(vsg::ref_ptr<const vsg::Node>(pending)).usage.total();
+    }
+
+    // without a device there is nothing to check against yet
+    if (budget > 0 && static_cast<double>(current + usage.total()) > static_cast<double>(budget) * BudgetFraction)
+        return false;
+
+    _models[node].usage = usage;
+    _pending.insert(node.get());
+    return true;
+}
+
+void MemoryBudget::compiled(const vsg::Node *node)
+{
+    std::scoped_lock lock(_mutex);
+    _pending.erase(node);
+}
+
+void MemoryBudget::release(const vsg::Node *node)
+{
+    std::scoped_lock lock(_mutex);
+    _pending.erase(node);
+    _models.erase(vsg::ref_ptr<const vsg::Node>(node));
+}
+
+void MemoryBudget::setName(const vsg::Node *node, const QString &name)
+{
+    std::scoped_lock lock(_mutex);
+    if (auto itr = _models.find(vsg::ref_ptr<const vsg::Node>(node)); itr != _models.end())
+        itr->second.name = name;
+}
+
+std::vector<MemoryBudget::Model> MemoryBudget::models() const
+{
+    std::scoped_lock lock(_mutex);
+
+    std::vector<Model> models;
+    for (auto &[node, model] : _models)
+        models.push_back(model);
+    return models;
+}
+
+MemoryUsage MemoryBudget::total() const
+{
+    std::scoped_lock lock(_mutex);
+
+    MemoryUsage total;
+    for (auto &[node, model] : _models)
+    {
+        total.vertex += model.usage.vertex;
+        total.index += model.usage.index;
+        total.texture += model.usage.texture;
+        total.descriptor += model.usage.descriptor;
+    }
+    return total;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <QString>
+
+#include <vsg/core/ref_ptr.h>
+#include <vsg/nodes/Node.h>
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <set>
+#include <vector>
+
+namespace vsgQt {
+
+// Device memory a subgraph needs once compiled, estimated from its data.
+// Textures sampled with mipmaps count a third more for the generated levels.
+struct MemoryUsage
+{
+    uint64_t vertex{0};
+    uint64_t index{0};
+    uint64_t texture{0};
+    uint64_t descriptor{0};
+
+    uint64_t total() const { return vertex + index + texture + descriptor; }
+};
+
+MemoryUsage estimateMemory(vsg::Node *node);
+
+// limits the samplers under node to the base level, returns false if none used mipmaps
+bool dropMipmaps(vsg::Node *node);
+
+// Accounts the device memory of every compiled model and reserves it for new
+// ones that fit the device local budget. The budget comes from VK_EXT_memory_budget
+// when the device supports it, otherwise from the heap sizes, and can be
+// capped further with setLimit().
+class MemoryBudget
+{
+public:
+
+    struct Model
+    {
+        QString name;
+        MemoryUsage usage;
+    };
+
+    void setup(VkInstance instance, VkPhysicalDevice physicalDevice);
+
+    // 0 for no limit besides the device's budget
+    void setLimit(uint64_t bytes);
+    uint64_t limit() const;
+
+    // device local budget and usage, the usage is the process' own from the
+    // driver with VK_EXT_memory_budget, else the sum of the accounted models
+    void query(uint64_t &budget, uint64_t &usage) const;
+    bool hasDriverBudget() const;
+
+    // checks usage against the budget and accounts it for node in one step,
+    // so concurrent loads cannot both take the last of the budget
+    bool reserve(vsg::ref_ptr<const vsg::Node> node, const MemoryUsage &usage);
+
+    // once node is compiled, its memory is part of the driver's usage
+    void compiled(const vsg::Node *node);
+
+    // for models that are not added to the scene after all
+    void release(const vsg::Node *node);
+
+    void setName(const vsg::Node *node, const QString &name);
+
+    std::vector<Model> models() const;
+    MemoryUsage total() const;
+
+private:
+
+    void queryLocked(uint64_t &budget, uint64_t &usage) const;
+
+    mutable std::mutex _mutex;
+    VkPhysicalDevice _physicalDevice{VK_NULL_HANDLE};
+    PFN_vkGetPhysicalDeviceMemoryProperties2 _getMemoryProperties2{nullptr};
+    bool _driverBudget{false};
+    uint64_t _limit{0};
+    std::map<vsg::ref_ptr<const vsg::Node>, Model> _models;
+    // reserved, but not yet allocated by a compile
+    std::set<const vsg::Node *> _pending;
+};
+
+}
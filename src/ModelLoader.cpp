@@ -0,0 +1,158 @@
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+
+#include "ModelLoader.h"
+#include "FunctionRunnable.h"
+
+#include <QLoggingCategory>
+#include <QThread>
+
+#include <vsg/io/read.h>
+
+#include <algorithm>
+
+namespace {
+static QLoggingCategory lc("modelloader");
+}
+
+using namespace vsgQt;
+
+ModelLoader::ModelLoader(QObject *parent)
+    : QObject(parent)
+{
+    _pool.setMaxThreadCount(std::max(1, QThread::idealThreadCount() / 2));
+}
+
+ModelLoader::~ModelLoader()
+{
+    cancelAll();
+    _pool.waitForDone();
+}
+
+void ModelLoader::setReadFunction(ReadFunction read)
+{
+    _read = std::move(read);
+}
+
+void ModelLoader::setCompileFunction(CompileFunction compile)
+{
+    _compile = std::move(compile);
+}
+
+void ModelLoader::setReleaseFunction(ReleaseFunction release)
+{
+    _release = std::move(release);
+}
+
+int ModelLoader::load(const QString &filename)
+{
+    auto job = std::make_shared<Job>();
+    job->filename = filename;
+
+    {
+        std::scoped_lock lock(_mutex);
+        job->id = _nextId++;
+        _jobs[job->id] = job;
+    }
+
+    emit loadStarted(job->id, filename);
+
+    _pool.start(new FunctionRunnable([this, job]() { run(job); }));
+
+    return job->id;
+}
+
+void ModelLoader::cancel(int id)
+{
+    std::scoped_lock lock(_mutex);
+
+    if (auto itr = _jobs.find(id); itr != _jobs.end())
+        itr->second->cancelled = true;
+}
+
+void ModelLoader::cancelAll()
+{
+    std::scoped_lock lock(_mutex);
+
+    for (auto &[id, job] : _jobs)
+        job->cancelled = true;
+}
+
+bool ModelLoader::isLoading() const
+{
+    std::scoped_lock lock(_mutex);
+    return !_jobs.empty();
+}
+
+bool ModelLoader::hasCompleted() const
+{
+    std::scoped_lock lock(_mutex);
+    return !_completed.empty();
+}
+
+std::vector<ModelLoader::Result> ModelLoader::takeCompleted()
+{
+    std::scoped_lock lock(_mutex);
+
+    std::vector<Result> completed;
+    completed.swap(_completed);
+    return completed;
+}
+
+void ModelLoader::notifyMerged(const Result &result)
+{
+    emit loadMerged(result.id, result.filename);
+}
+
+void ModelLoader::run(std::shared_ptr<Job> job)
+{
+    emit loadProgress(job->id, 0);
+
+    if (job->cancelled)
+        return finish(job, {});
+
+    auto node = _read ? _read(job->filename) : vsg::read_cast<vsg::Node>(job->filename.toStdString());
+
+    if (!node.valid())
+    {
+        qCWarning(lc) << "Failed to read" << job->filename;
+        return finish(job, {});
+    }
+
+    emit loadProgress(job->id, 50);
+
+    if (job->cancelled)
+        return finish(job, {});
+
+    if (_compile && !_compile(node))
+    {
+        qCWarning(lc) << "Failed to compile" << job->filename;
+        return finish(job, {});
+    }
+
+    emit loadProgress(job->id, 100);
+
+    finish(job, node);
+}
+
+void ModelLoader::finish(const std::shared_ptr<Job> &job, vsg::ref_ptr<vsg::Node> node)
+{
+    // a cancelled load is dropped even when it got through compile
+    const bool success = node.valid() && !job->cancelled;
+    if (node.valid() && !success && _release)
+        _release(node);
+
+    {
+        std::scoped_lock lock(_mutex);
+        _jobs.erase(job->id);
+
+        if (success)
+            _completed.push_back({job->id, job->filename, node});
+    }
+
+    if (success)
+        emit loadCompleted(job->id, job->filename);
+    else
+        emit loadFailed(job->id, job->filename);
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <QObject>
+#include <QString>
+#include <QThreadPool>
+
+#include <vsg/core/ref_ptr.h>
+#include <vsg/nodes/Node.h>
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace vsgQt {
+
+// Reads and compiles models on a worker thread pool. Finished models are
+// collected until the render loop picks them up between two frames.
+class ModelLoader : public QObject
+{
+    Q_OBJECT
+public:
+
+    using ReadFunction = std::function<vsg::ref_ptr<vsg::Node>(const QString &filename)>;
+    using CompileFunction = std::function<bool(vsg::Node *node)>;
+    using ReleaseFunction = std::function<void(vsg::Node *node)>;
+
+    struct Result
+    {
+        int id{-1};
+        QString filename;
+        vsg::ref_ptr<vsg::Node> node;
+    };
+
+    explicit ModelLoader(QObject *parent = nullptr);
+    virtual ~ModelLoader() override;
+
+    // defaults to vsg::read_cast
+    void setReadFunction(ReadFunction read);
+    void setCompileFunction(CompileFunction compile);
+
+    // called for a compiled model that is dropped because its load was cancelled
+    void setReleaseFunction(ReleaseFunction release);
+
+    int load(const QString &filename);
+    void cancel(int id);
+    void cancelAll();
+
+    bool isLoading() const;
+    bool hasCompleted() const;
+
+    std::vector<Result> takeCompleted();
+
+    // called once a completed model is part of the scene
+    void notifyMerged(const Result &result);
+
+signals:
+
+    void loadStarted(int id, const QString &filename);
+    void loadProgress(int id, int percent);
+    void loadCompleted(int id, const QString &filename);
+    void loadMerged(int id, const QString &filename);
+    void loadFailed(int id, const QString &filename);
+
+private:
+
+    struct Job
+    {
+        int id{-1};
+        QString filename;
+        std::atomic<bool> cancelled{false};
+    };
+
+    void run(std::shared_ptr<Job> job);
+    void finish(const std::shared_ptr<Job> &job, vsg::ref_ptr<vsg::Node> node);
+
+    QThreadPool _pool;
+    ReadFunction _read;
+    CompileFunction _compile;
+    ReleaseFunction _release;
+
+    mutable std::mutex _mutex;
+    std::map<int, std::shared_ptr<Job>> _jobs;
+    std::vector<Result> _completed;
+    int _nextId{1};
+};
+
+}
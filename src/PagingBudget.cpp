@@ -0,0 +1,121 @@
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+
+#include "PagingBudget.h"
+
+#include <vsg/all.h>
+
+#include <algorithm>
+
+namespace {
+
+class CollectDataSize : public vsg::Visitor
+{
+public:
+
+    void apply(vsg::Object &object) override
+    {
+        object.traverse(*this);
+    }
+
+    void apply(vsg::Data &data) override
+    {
+        size += data.dataSize();
+    }
+
+    size_t size{0};
+};
+
+class AssignTileOptions : public vsg::Visitor
+{
+public:
+
+    explicit AssignTileOptions(vsg::ref_ptr<vsg::Options> options) : _options(options) {}
+
+    void apply(vsg::Object &object) override
+    {
+        object.traverse(*this);
+    }
+
+    void apply(vsg::PagedLOD &plod) override
+    {
+        plod.options = _options;
+        plod.traverse(*this);
+    }
+
+private:
+    vsg::ref_ptr<vsg::Options> _options;
+};
+
+}
+
+namespace vsgQt {
+
+class PagingBudget::MeasuringReaderWriter : public vsg::Inherit<vsg::ReaderWriter, MeasuringReaderWriter>
+{
+public:
+
+    vsg::ref_ptr<vsg::Object> read(const vsg::Path &filename, vsg::ref_ptr<const vsg::Options> options) const override
+    {
+        auto object = _next->read(filename, options);
+
+        if (object)
+        {
+            CollectDataSize collect;
+            object->accept(collect);
+
+            _bytes += collect.size;
+            ++_tiles;
+        }
+
+        return object;
+    }
+
+    size_t averageTileSize() const
+    {
+        const auto tiles = _tiles.load();
+        return tiles > 0 ? _bytes / tiles : 0;
+    }
+
+private:
+
+    // the native .vsgb/.vsgt reader does the actual reading
+    vsg::ref_ptr<vsg::ReaderWriter> _next{vsg::VSG::create()};
+    mutable std::atomic<size_t> _bytes{0};
+    mutable std::atomic<size_t> _tiles{0};
+};
+
+}
+
+using namespace vsgQt;
+
+PagingBudget::PagingBudget()
+    : _readerWriter(MeasuringReaderWriter::create())
+    , _options(vsg::Options::create())
+{
+    _options->readerWriters.push_back(_readerWriter);
+}
+
+size_t PagingBudget::averageTileSize() const
+{
+    return _readerWriter->averageTileSize();
+}
+
+uint32_t PagingBudget::targetTiles() const
+{
+    // until the first tiles are in, a tile is assumed to be 1 MB
+    const size_t tileSize = std::max<size_t>(averageTileSize(), size_t(1) << 20);
+    return static_cast<uint32_t>(std::max<size_t>(1, _budget / tileSize));
+}
+
+void PagingBudget::prepare(vsg::Node *model) const
+{
+    AssignTileOptions assign(_options);
+    model->accept(assign);
+}
+
+void PagingBudget::apply(vsg::DatabasePager *pager) const
+{
+    pager->targetMaxNumPagedLODWithHighResSubgraphs = targetTiles();
+}
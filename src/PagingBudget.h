@@ -0,0 +1,54 @@
+#pragma once
+
+#include <vsg/core/ref_ptr.h>
+#include <vsg/io/Options.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace vsg {
+class DatabasePager;
+class Node;
+}
+
+namespace vsgQt {
+
+// Keeps the tiles held by a vsg::DatabasePager within a memory budget. Tiles
+// are read through a ReaderWriter that measures their data, models get
+// these options for their PagedLOD nodes only, so only tiles are measured.
+// The pager's target number of high resolution tiles is the budget divided
+// by the average tile size. Beyond that target the pager drops the tiles
+// that have gone longest without being rendered, and it serves requests by
+// their screen size.
+class PagingBudget
+{
+public:
+
+    PagingBudget();
+
+    // options the tiles of paged databases are read with
+    vsg::ref_ptr<vsg::Options> tileOptions() const { return _options; }
+
+    // has the PagedLOD nodes of a model read with other options read their tiles with tileOptions()
+    void prepare(vsg::Node *model) const;
+
+    size_t budget() const { return _budget; }
+    void setBudget(size_t bytes) { _budget = bytes; }
+
+    size_t averageTileSize() const;
+    uint32_t targetTiles() const;
+
+    // called between frames with the viewer's pager
+    void apply(vsg::DatabasePager *pager) const;
+
+    class MeasuringReaderWriter;
+
+private:
+
+    std::atomic<size_t> _budget{size_t(512) << 20};
+    vsg::ref_ptr<MeasuringReaderWriter> _readerWriter;
+    vsg::ref_ptr<vsg::Options> _options;
+};
+
+}
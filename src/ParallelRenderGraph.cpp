@@ -0,0 +1,245 @@
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+
+#include "ParallelRenderGraph.h"
+#include "FunctionRunnable.h"
+
+#include <vsg/all.h>
+
+#include <algorithm>
+#include <map>
+#include <typeinfo>
+
+namespace {
+
+class CountCommands : public vsg::Visitor
+{
+public:
+
+    void apply(vsg::Object &object) override
+    {
+        object.traverse(*this);
+    }
+
+    void apply(vsg::Command &) override
+    {
+        ++count;
+    }
+
+    size_t count{0};
+};
+
+size_t countCommands(vsg::Node *node)
+{
+    CountCommands counter;
+    node->accept(counter);
+    return std::max<size_t>(1, counter.count);
+}
+
+// a subgraph together with the StateGroups above it, outermost first
+struct Unit
+{
+    std::vector<vsg::StateGroup *> stateGroups;
+    vsg::ref_ptr<vsg::Node> node;
+    size_t weight{0};
+};
+
+}
+
+vsg::Group::Children vsgQt::partitionScene(vsg::Group *root, uint32_t numPartitions)
+{
+    numPartitions = std::max(1u, numPartitions);
+
+    std::vector<Unit> units;
+    for (auto &child : root->getChildren())
+        units.push_back({{}, child, countCommands(child)});
+
+    // split the heaviest unit until there are enough units to balance the
+    // partitions, or nothing can be split any further
+    const size_t targetUnits = numPartitions * 4;
+    while (units.size() < targetUnits)
+    {
+        auto heaviest = std::max_element(units.begin(), units.end(), [](const Unit &lhs, const Unit &rhs) { return lhs.weight < rhs.weight; });
+        if (heaviest == units.end())
+            break;
+
+        auto group = heaviest->node->cast<vsg::Group>();
+        auto stateGroup = heaviest->node->cast<vsg::StateGroup>();
+        const bool splittable = group && (typeid(*group) == typeid(vsg::Group) || stateGroup) && group->getChildren().size() > 1;
+        if (!splittable)
+        {
+            // the heaviest unit is a leaf, the split is as good as it gets
+            break;
+        }
+
+        Unit unit = *heaviest;
+        units.erase(heaviest);
+
+        auto stateGroups = unit.stateGroups;
+        if (stateGroup)
+            stateGroups.push_back(stateGroup);
+
+        for (auto &child : group->getChildren())
+            units.push_back({stateGroups, child, countCommands(child)});
+    }
+
+    // largest first into the currently lightest partition
+    std::sort(units.begin(), units.end(), [](const Unit &lhs, const Unit &rhs) { return lhs.weight > rhs.weight; });
+
+    std::vector<std::vector<Unit *>> bins(std::min<size_t>(numPartitions, units.size()));
+    std::vector<size_t> weights(bins.size(), 0);
+    for (auto &unit : units)
+    {
+        const auto lightest = std::min_element(weights.begin(), weights.end()) - weights.begin();
+        bins[lightest].push_back(&unit);
+        weights[lightest] += unit.weight;
+    }
+
+    vsg::Group::Children partitions;
+    for (auto &bin : bins)
+    {
+        auto partition = vsg::Group::create();
+
+        // units below the same StateGroups share one copy of them
+        std::map<std::vector<vsg::StateGroup *>, vsg::ref_ptr<vsg::Group>> parents;
+        for (auto unit : bin)
+        {
+            auto &parent = parents[unit->stateGroups];
+            if (!parent)
+            {
+                vsg::ref_ptr<vsg::Group> outer;
+                vsg::Group *inner = partition;
+                for (auto original : unit->stateGroups)
+                {
+                    auto copy = vsg::StateGroup::create();
+                    copy->getStateCommands() = original->getStateCommands();
+                    inner->addChild(copy);
+                    inner = copy;
+                }
+                parent = inner;
+            }
+
+            parent->addChild(unit->node);
+        }
+
+        partitions.push_back(partition);
+    }
+
+    return partitions;
+}
+
+using namespace vsgQt;
+
+ParallelRenderGraph::ParallelRenderGraph(const vsg::RenderGraph &settings, vsg::ref_ptr<vsg::Group> in_partitions, uint32_t numThreads, uint32_t maxSlot)
+    : partitions(in_partitions)
+    , _maxSlot(maxSlot)
+{
+    camera = settings.camera;
+    window = settings.window;
+    framebuffer = settings.framebuffer;
+    renderArea = settings.renderArea;
+    clearValues = settings.clearValues;
+
+    // the compile traversal reaches the scene through the regular children
+    addChild(partitions);
+
+    // the calling thread records one partition itself
+    _pool.setMaxThreadCount(std::max(1, static_cast<int>(numThreads) - 1));
+}
+
+ParallelRenderGraph::~ParallelRenderGraph()
+{
+    _pool.waitForDone();
+}
+
+void ParallelRenderGraph::accept(vsg::RecordTraversal &recordTraversal) const
+{
+    auto &primary = *recordTraversal.state->_commandBuffer;
+
+    VkFramebuffer vkFramebuffer = framebuffer ? VkFramebuffer(*framebuffer) : VK_NULL_HANDLE;
+    VkRenderPass vkRenderPass = framebuffer ? VkRenderPass(*framebuffer->getRenderPass()) : VK_NULL_HANDLE;
+    if (window)
+    {
+        vkFramebuffer = *window->framebuffer(window->imageIndex());
+        vkRenderPass = *window->getOrCreateRenderPass();
+    }
+
+    VkRenderPassBeginInfo renderPassInfo = {};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    renderPassInfo.renderPass = vkRenderPass;
+    renderPassInfo.framebuffer = vkFramebuffer;
+    renderPassInfo.renderArea = renderArea;
+    renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+    renderPassInfo.pClearValues = clearValues.data();
+    vkCmdBeginRenderPass(primary, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+    const auto &children = partitions->getChildren();
+
+    std::vector<Slot> *slots = nullptr;
+    {
+        std::scoped_lock lock(_mutex);
+        slots = &_slots[&primary];
+        if (slots->size() < children.size())
+            slots->resize(children.size());
+    }
+
+    VkCommandBufferInheritanceInfo inheritanceInfo = {};
+    inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritanceInfo.renderPass = vkRenderPass;
+    inheritanceInfo.subpass = 0;
+    inheritanceInfo.framebuffer = vkFramebuffer;
+
+    for (size_t i = 1; i < children.size(); ++i)
+    {
+        _pool.start(new FunctionRunnable([this, slot = &(*slots)[i], partition = children[i].get(), &inheritanceInfo, &recordTraversal]() {
+            record(*slot, partition, inheritanceInfo, recordTraversal);
+        }));
+    }
+
+    if (!children.empty())
+        record(slots->front(), children.front().get(), inheritanceInfo, recordTraversal);
+
+    _pool.waitForDone();
+
+    std::vector<VkCommandBuffer> commandBuffers;
+    for (size_t i = 0; i < children.size(); ++i)
+        commandBuffers.push_back(*(*slots)[i].commandBuffer);
+
+    if (!commandBuffers.empty())
+        vkCmdExecuteCommands(primary, static_cast<uint32_t>(commandBuffers.size()), commandBuffers.data());
+
+    vkCmdEndRenderPass(primary);
+}
+
+void ParallelRenderGraph::record(Slot &slot, vsg::Node *partition, const VkCommandBufferInheritanceInfo &inheritanceInfo, vsg::RecordTraversal &primary) const
+{
+    auto device = primary.state->_commandBuffer->getDevice();
+
+    // command pools are not thread safe, every partition has its own
+    if (!slot.commandPool)
+    {
+        const auto queueFamily = device->getPhysicalDevice()->getQueueFamily(VK_QUEUE_GRAPHICS_BIT);
+        slot.commandPool = vsg::CommandPool::create(device, queueFamily);
+        slot.commandBuffer = vsg::CommandBuffer::create(device, slot.commandPool, VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+    }
+    else
+    {
+        vkResetCommandPool(*device, *slot.commandPool, 0);
+    }
+
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    beginInfo.pInheritanceInfo = &inheritanceInfo;
+    vkBeginCommandBuffer(*slot.commandBuffer, &beginInfo);
+
+    vsg::RecordTraversal recordTraversal(slot.commandBuffer, _maxSlot, primary.frameStamp);
+    recordTraversal.databasePager = primary.databasePager;
+    if (camera)
+        recordTraversal.setProjectionAndViewMatrix(camera->projectionMatrix->transform(), camera->viewMatrix->transform());
+
+    partition->accept(recordTraversal);
+
+    vkEndCommandBuffer(*slot.commandBuffer);
+}
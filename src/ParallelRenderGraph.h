@@ -0,0 +1,61 @@
+#pragma once
+
+#include <QThreadPool>
+
+#include <vsg/core/ref_ptr.h>
+#include <vsg/nodes/Group.h>
+#include <vsg/viewer/RenderGraph.h>
+
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace vsgQt {
+
+// Splits the scene below root into up to numPartitions groups of similar
+// draw count. The scene is only split through Groups and StateGroups; a
+// StateGroup that is split is repeated in every partition, sharing its
+// state commands. Draw order between partitions is not kept, which is fine
+// for depth tested opaque geometry.
+vsg::Group::Children partitionScene(vsg::Group *root, uint32_t numPartitions);
+
+// A RenderGraph whose render pass runs secondary command buffers. Every
+// child of partitions is recorded into its own secondary command buffer,
+// all but the first one on a worker pool, and the primary command buffer
+// only begins the render pass and executes them.
+class ParallelRenderGraph : public vsg::Inherit<vsg::RenderGraph, ParallelRenderGraph>
+{
+public:
+
+    // takes camera, window, render area and clear values from settings
+    ParallelRenderGraph(const vsg::RenderGraph &settings, vsg::ref_ptr<vsg::Group> partitions, uint32_t numThreads, uint32_t maxSlot = 2);
+
+    void accept(vsg::RecordTraversal &recordTraversal) const override;
+
+    vsg::ref_ptr<vsg::Group> partitions;
+
+protected:
+
+    virtual ~ParallelRenderGraph();
+
+    struct Slot
+    {
+        vsg::ref_ptr<vsg::CommandPool> commandPool;
+        vsg::ref_ptr<vsg::CommandBuffer> commandBuffer;
+    };
+
+    void record(Slot &slot, vsg::Node *partition, const VkCommandBufferInheritanceInfo &inheritanceInfo, vsg::RecordTraversal &primary) const;
+
+    uint32_t _maxSlot;
+    mutable QThreadPool _pool;
+
+    // One command pool and buffer per partition and primary command buffer.
+    // The CommandGraph only records into a primary again once the fence of
+    // its last submission has signalled, and the secondaries it executed were
+    // pending exactly as long. Swapchain images are no such guarantee, with
+    // MAILBOX they are not acquired in turn.
+    mutable std::mutex _mutex;
+    mutable std::map<const vsg::CommandBuffer *, std::vector<Slot>> _slots;
+};
+
+}
@@ -0,0 +1,586 @@
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+
+#include "Picker.h"
+#include "FunctionRunnable.h"
+
+#include <QLoggingCategory>
+
+#include <vsg/all.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <numeric>
+
+namespace {
+static QLoggingCategory lc("picker");
+
+// triangles per leaf of the hierarchy, and meshes per leaf of a model's hierarchy
+constexpr uint32_t LeafSize = 4;
+constexpr uint32_t ModelLeafSize = 2;
+
+// median splits halve every node, so a hierarchy of 2^32 entries is 33 deep
+constexpr uint32_t StackSize = 64;
+
+vsg::dbox transformBounds(const vsg::dbox &local, const vsg::dmat4 &matrix)
+{
+    vsg::dbox bounds;
+    for (int corner = 0; corner < 8; ++corner)
+    {
+        const vsg::dvec3 point(corner & 1 ? local.max.x : local.min.x, corner & 2 ? local.max.y : local.min.y, corner & 4 ? local.max.z : local.min.z);
+        bounds.add(matrix * point);
+    }
+    return bounds;
+}
+
+// slab test of the segment start + ratio * direction, ratio in [0, maxRatio]
+bool overlapsBox(const vsg::dvec3 &min, const vsg::dvec3 &max, const vsg::dvec3 &start, const vsg::dvec3 &inverse, double maxRatio)
+{
+    double near = 0.0;
+    double far = maxRatio;
+    for (int c = 0; c < 3; ++c)
+    {
+        double t0 = (min[c] - start[c]) * inverse[c];
+        double t1 = (max[c] - start[c]) * inverse[c];
+        if (t0 > t1)
+            std::swap(t0, t1);
+
+        // NaN from a zero direction inside the slab leaves the range as it is
+        near = t0 > near ? t0 : near;
+        far = t1 < far ? t1 : far;
+        if (near > far)
+            return false;
+    }
+    return true;
+}
+}
+
+namespace vsgQt {
+
+class Picker::Bvh
+{
+public:
+
+    explicit Bvh(const vsg::VertexIndexDraw &draw)
+    {
+        if (draw.arrays.empty() || !draw.indices || draw.indexCount < 3)
+            return;
+
+        _positions = draw.arrays.front().cast<vsg::vec3Array>();
+        if (!_positions)
+            return;
+
+        auto read = [&](auto &array) {
+            const auto end = std::min<size_t>(array.valueCount(), static_cast<size_t>(draw.firstIndex) + draw.indexCount);
+            for (size_t i = draw.firstIndex; i + 2 < end; i += 3)
+            {
+                bool inside = true;
+                uint32_t triangle[3];
+                for (size_t k = 0; k < 3; ++k)
+                {
+                    const auto index = static_cast<int64_t>(array[i + k]) + draw.vertexOffset;
+                    inside = inside && index >= 0 && index < static_cast<int64_t>(_positions->valueCount());
+                    triangle[k] = static_cast<uint32_t>(index);
+                }
+
+                // degenerate references still count, so triangle numbers match the draw
+                if (!inside)
+                    triangle[0] = triangle[1] = triangle[2] = 0;
+                _indices.insert(_indices.end(), triangle, triangle + 3);
+            }
+        };
+
+        if (auto array = draw.indices.cast<vsg::ushortArray>())
+            read(*array);
+        else if (auto array = draw.indices.cast<vsg::uintArray>())
+            read(*array);
+
+        const auto numTriangles = static_cast<uint32_t>(_indices.size() / 3);
+        if (numTriangles == 0)
+            return;
+
+        _triangles.resize(numTriangles);
+        std::iota(_triangles.begin(), _triangles.end(), 0u);
+
+        _centroids.resize(numTriangles);
+        for (uint32_t t = 0; t < numTriangles; ++t)
+            _centroids[t] = (position(t, 0) + position(t, 1) + position(t, 2)) / 3.0f;
+
+        _nodes.reserve(2 * numTriangles / LeafSize + 1);
+        const auto depth = build(0, numTriangles, 1);
+        assert(depth < StackSize);
+        (void)depth;
+        _centroids = {};
+
+        // leaves reference their triangles in order
+        std::vector<uint32_t> indices(_indices.size());
+        for (uint32_t t = 0; t < numTriangles; ++t)
+            std::copy_n(&_indices[_triangles[t] * 3], 3, &indices[t * 3]);
+        _indices.swap(indices);
+    }
+
+    bool valid() const { return !_nodes.empty(); }
+
+    vsg::dbox bounds() const
+    {
+        vsg::dbox bounds;
+        if (!_nodes.empty())
+        {
+            bounds.add(vsg::dvec3(_nodes.front().min));
+            bounds.add(vsg::dvec3(_nodes.front().max));
+        }
+        return bounds;
+    }
+
+    // closest hit of the segment in the mesh's coordinates, ratio is updated when closer
+    bool intersect(const vsg::dvec3 &start, const vsg::dvec3 &end, double &ratio, uint32_t &primitiveIndex) const
+    {
+        if (_nodes.empty())
+            return false;
+
+        const auto direction = end - start;
+        const vsg::dvec3 inverse(1.0 / direction.x, 1.0 / direction.y, 1.0 / direction.z);
+
+        bool hit = false;
+        uint32_t stack[StackSize];
+        uint32_t size = 0;
+        stack[size++] = 0;
+
+        while (size > 0)
+        {
+            const auto &node = _nodes[stack[--size]];
+            if (!overlapsBox(vsg::dvec3(node.min), vsg::dvec3(node.max), start, inverse, std::min(ratio, 1.0)))
+                continue;
+
+            if (node.count > 0)
+            {
+                for (uint32_t t = node.first; t < node.first + node.count; ++t)
+                {
+                    double r;
+                    if (intersectTriangle(t, start, direction, r) && r < ratio)
+                    {
+                        ratio = r;
+                        primitiveIndex = _triangles[t];
+                        hit = true;
+                    }
+                }
+            }
+            else
+            {
+                stack[size++] = node.first;
+                stack[size++] = static_cast<uint32_t>(&node - _nodes.data()) + 1;
+            }
+        }
+
+        return hit;
+    }
+
+private:
+
+    // count 0 marks an interior node, its children are the next node and first
+    struct Node
+    {
+        vsg::vec3 min;
+        vsg::vec3 max;
+        uint32_t first{0};
+        uint32_t count{0};
+    };
+
+    const vsg::vec3 &position(uint32_t triangle, uint32_t corner) const
+    {
+        return (*_positions)[_indices[triangle * 3 + corner]];
+    }
+
+    // returns the depth of the subtree, a traversal stack holds at most one entry per level
+    uint32_t build(uint32_t first, uint32_t count, uint32_t depth)
+    {
+        const auto index = static_cast<uint32_t>(_nodes.size());
+        _nodes.emplace_back();
+
+        const float limit = std::numeric_limits<float>::max();
+        vsg::vec3 min(limit, limit, limit), max(-limit, -limit, -limit);
+        vsg::vec3 centroidMin = min, centroidMax = max;
+        for (uint32_t i = first; i < first + count; ++i)
+        {
+            const auto t = _triangles[i];
+            for (uint32_t corner = 0; corner < 3; ++corner)
+            {
+                const auto &p = position(t, corner);
+                for (int c = 0; c < 3; ++c)
+                {
+                    min[c] = std::min(min[c], p[c]);
+                    max[c] = std::max(max[c], p[c]);
+                }
+            }
+            for (int c = 0; c < 3; ++c)
+            {
+                centroidMin[c] = std::min(centroidMin[c], _centroids[t][c]);
+                centroidMax[c] = std::max(centroidMax[c], _centroids[t][c]);
+            }
+        }
+
+        _nodes[index].min = min;
+        _nodes[index].max = max;
+
+        const auto extent = centroidMax - centroidMin;
+        const int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+
+        if (count <= LeafSize || extent[axis] <= 0.0f)
+        {
+            _nodes[index].first = first;
+            _nodes[index].count = count;
+            return depth;
+        }
+
+        // median split along the longest axis of the centroids
+        const auto middle = first + count / 2;
+        std::nth_element(_triangles.begin() + first, _triangles.begin() + middle, _triangles.begin() + first + count, [&](uint32_t a, uint32_t b) {
+            return _centroids[a][axis] < _centroids[b][axis];
+        });
+
+        const auto leftDepth = build(first, middle - first, depth + 1);
+        const auto right = static_cast<uint32_t>(_nodes.size());
+        const auto rightDepth = build(middle, first + count - middle, depth + 1);
+        _nodes[index].first = right;
+        return std::max(leftDepth, rightDepth);
+    }
+
+    // Moeller-Trumbore, both sides
+    bool intersectTriangle(uint32_t t, const vsg::dvec3 &start, const vsg::dvec3 &direction, double &ratio) const
+    {
+        const vsg::dvec3 p0(position(t, 0)), p1(position(t, 1)), p2(position(t, 2));
+        const auto edge1 = p1 - p0;
+        const auto edge2 = p2 - p0;
+
+        const auto h = vsg::cross(direction, edge2);
+        const auto a = vsg::dot(edge1, h);
+        if (std::abs(a) < 1e-12)
+            return false;
+
+        const auto f = 1.0 / a;
+        const auto s = start - p0;
+        const auto u = f * vsg::dot(s, h);
+        if (u < 0.0 || u > 1.0)
+            return false;
+
+        const auto q = vsg::cross(s, edge1);
+        const auto v = f * vsg::dot(direction, q);
+        if (v < 0.0 || u + v > 1.0)
+            return false;
+
+        ratio = f * vsg::dot(edge2, q);
+        return ratio >= 0.0 && ratio <= 1.0;
+    }
+
+    vsg::ref_ptr<vsg::vec3Array> _positions;
+    std::vector<uint32_t> _indices;
+    std::vector<uint32_t> _triangles;
+    std::vector<vsg::vec3> _centroids;
+    std::vector<Node> _nodes;
+};
+
+// the meshes and instances of a model, in the order of the leaves of a
+// hierarchy over their world bounds
+struct Picker::Model
+{
+    // count 0 marks an interior node, its children are the next node and first
+    struct Node
+    {
+        vsg::dvec3 min;
+        vsg::dvec3 max;
+        uint32_t first{0};
+        uint32_t count{0};
+    };
+
+    explicit Model(std::vector<Mesh> unordered)
+    {
+        if (unordered.empty())
+            return;
+
+        _bounds.resize(unordered.size());
+        for (size_t i = 0; i < unordered.size(); ++i)
+            _bounds[i] = transformBounds(unordered[i].bvh->bounds(), unordered[i].matrix);
+
+        _order.resize(unordered.size());
+        std::iota(_order.begin(), _order.end(), 0u);
+
+        nodes.reserve(2 * unordered.size() / ModelLeafSize + 1);
+        const auto depth = build(0, static_cast<uint32_t>(unordered.size()), 1);
+        assert(depth < StackSize);
+        (void)depth;
+
+        meshes.reserve(unordered.size());
+        for (auto i : _order)
+            meshes.push_back(std::move(unordered[i]));
+
+        _bounds = {};
+        _order = {};
+    }
+
+    // visits the meshes whose world bounds the segment passes before maxRatio, which visit may lower
+    template<typename F>
+    void traverse(const vsg::dvec3 &start, const vsg::dvec3 &end, const double &maxRatio, F visit) const
+    {
+        if (nodes.empty())
+            return;
+
+        const auto direction = end - start;
+        const vsg::dvec3 inverse(1.0 / direction.x, 1.0 / direction.y, 1.0 / direction.z);
+
+        uint32_t stack[StackSize];
+        uint32_t size = 0;
+        stack[size++] = 0;
+
+        while (size > 0)
+        {
+            const auto &node = nodes[stack[--size]];
+            if (!overlapsBox(node.min, node.max, start, inverse, std::min(maxRatio, 1.0)))
+                continue;
+
+            if (node.count > 0)
+            {
+                for (uint32_t m = node.first; m < node.first + node.count; ++m)
+                    visit(meshes[m]);
+            }
+            else
+            {
+                stack[size++] = node.first;
+                stack[size++] = static_cast<uint32_t>(&node - nodes.data()) + 1;
+            }
+        }
+    }
+
+    std::vector<Mesh> meshes;
+    std::vector<Node> nodes;
+
+private:
+
+    uint32_t build(uint32_t first, uint32_t count, uint32_t depth)
+    {
+        const auto index = static_cast<uint32_t>(nodes.size());
+        nodes.emplace_back();
+
+        vsg::dbox bounds, centroids;
+        for (uint32_t i = first; i < first + count; ++i)
+        {
+            const auto &box = _bounds[_order[i]];
+            bounds.add(box.min);
+            bounds.add(box.max);
+            centroids.add((box.min + box.max) * 0.5);
+        }
+
+        nodes[index].min = bounds.min;
+        nodes[index].max = bounds.max;
+
+        const auto extent = centroids.max - centroids.min;
+        const int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+
+        if (count <= ModelLeafSize || extent[axis] <= 0.0)
+        {
+            nodes[index].first = first;
+            nodes[index].count = count;
+            return depth;
+        }
+
+        const auto middle = first + count / 2;
+        std::nth_element(_order.begin() + first, _order.begin() + middle, _order.begin() + first + count, [&](uint32_t a, uint32_t b) {
+            return _bounds[a].min[axis] + _bounds[a].max[axis] < _bounds[b].min[axis] + _bounds[b].max[axis];
+        });
+
+        const auto leftDepth = build(first, middle - first, depth + 1);
+        const auto right = static_cast<uint32_t>(nodes.size());
+        const auto rightDepth = build(middle, first + count - middle, depth + 1);
+        nodes[index].first = right;
+        return std::max(leftDepth, rightDepth);
+    }
+
+    std::vector<vsg::dbox> _bounds;
+    std::vector<uint32_t> _order;
+};
+
+}
+
+namespace {
+
+class CollectMeshes : public vsg::Visitor
+{
+public:
+
+    struct Mesh
+    {
+        std::vector<vsg::ref_ptr<vsg::Node>> nodePath;
+        vsg::dmat4 matrix;
+        uint32_t instanceIndex;
+        std::shared_ptr<const vsgQt::Picker::Bvh> bvh;
+    };
+
+    void apply(vsg::Object &object) override
+    {
+        object.traverse(*this);
+    }
+
+    void apply(vsg::Node &node) override
+    {
+        path.emplace_back(&node);
+        node.traverse(*this);
+        path.pop_back();
+    }
+
+    void apply(vsg::MatrixTransform &transform) override
+    {
+        path.emplace_back(&transform);
+        matrices.push_back(matrices.back() * transform.matrix);
+        transform.traverse(*this);
+        matrices.pop_back();
+        path.pop_back();
+    }
+
+    void apply(vsg::LOD &lod) override
+    {
+        // the first child is the one with the most detail
+        path.emplace_back(&lod);
+        if (!lod.getChildren().empty() && lod.getChildren().front().node)
+            lod.getChildren().front().node->accept(*this);
+        path.pop_back();
+    }
+
+    void apply(vsg::PagedLOD &) override
+    {
+        // tiles come and go with the pager
+    }
+
+    void apply(vsg::VertexIndexDraw &draw) override
+    {
+        auto &bvh = bvhs[&draw];
+        if (!bvh)
+            bvh = std::make_shared<const vsgQt::Picker::Bvh>(draw);
+        if (!bvh->valid())
+            return;
+
+        path.emplace_back(&draw);
+
+        vsg::ref_ptr<vsg::mat4Array> instances;
+        if (draw.instanceCount > 1 && draw.arrays.size() > 1)
+            instances = draw.arrays.back().cast<vsg::mat4Array>();
+
+        if (instances && instances->valueCount() >= draw.instanceCount)
+        {
+            for (uint32_t i = 0; i < draw.instanceCount; ++i)
+                meshes.push_back({path, matrices.back() * vsg::dmat4((*instances)[i]), i, bvh});
+        }
+        else
+        {
+            meshes.push_back({path, matrices.back(), 0, bvh});
+        }
+
+        path.pop_back();
+    }
+
+    std::vector<vsg::ref_ptr<vsg::Node>> path;
+    std::vector<vsg::dmat4> matrices{vsg::dmat4()};
+    std::map<const vsg::VertexIndexDraw *, std::shared_ptr<const vsgQt::Picker::Bvh>> bvhs;
+    std::vector<Mesh> meshes;
+};
+
+}
+
+using namespace vsgQt;
+
+Picker::Picker()
+{
+    _pool.setMaxThreadCount(1);
+}
+
+Picker::~Picker()
+{
+    clear();
+    _pool.clear();
+    _pool.waitForDone();
+}
+
+void Picker::add(vsg::ref_ptr<vsg::Node> model)
+{
+    if (!model)
+        return;
+
+    uint64_t generation;
+    {
+        std::scoped_lock lock(_mutex);
+        generation = _generation;
+    }
+
+    _pool.start(new FunctionRunnable([this, model, generation]() {
+        CollectMeshes collect;
+        model->accept(collect);
+
+        std::vector<Mesh> meshes;
+        meshes.reserve(collect.meshes.size());
+        for (auto &mesh : collect.meshes)
+            meshes.push_back({mesh.nodePath, vsg::inverse(mesh.matrix), mesh.matrix, mesh.instanceIndex, mesh.bvh});
+
+        auto built = std::make_shared<const Model>(std::move(meshes));
+        qCDebug(lc) << "Built hierarchies of" << collect.bvhs.size() << "meshes," << built->meshes.size() << "pickable";
+
+        std::scoped_lock lock(_mutex);
+        if (generation == _generation)
+            _models.push_back(built);
+    }));
+}
+
+void Picker::clear()
+{
+    std::scoped_lock lock(_mutex);
+    _models.clear();
+    ++_generation;
+}
+
+Picker::Hit Picker::intersect(const vsg::dvec3 &start, const vsg::dvec3 &end) const
+{
+    std::vector<std::shared_ptr<const Model>> models;
+    {
+        std::scoped_lock lock(_mutex);
+        models = _models;
+    }
+
+    Hit hit;
+    const Mesh *picked = nullptr;
+    double ratio = std::numeric_limits<double>::max();
+    hit.ratio = ratio;
+
+    for (auto &model : models)
+    {
+        // boxes beyond the closest hit so far are skipped
+        model->traverse(start, end, ratio, [&](const Mesh &mesh) {
+            // an affine transform keeps the ratio along the segment
+            uint32_t primitiveIndex = 0;
+            if (mesh.bvh->intersect(mesh.inverse * start, mesh.inverse * end, ratio, primitiveIndex))
+            {
+                hit.valid = true;
+                hit.nodePath = mesh.nodePath;
+                hit.primitiveIndex = primitiveIndex;
+                hit.instanceIndex = mesh.instanceIndex;
+                hit.ratio = ratio;
+                picked = &mesh;
+            }
+        });
+    }
+
+    if (picked)
+    {
+        hit.worldPosition = start + (end - start) * hit.ratio;
+        hit.bounds = transformBounds(picked->bvh->bounds(), picked->matrix);
+    }
+    else
+        hit.ratio = 0.0;
+
+    return hit;
+}
+
+void Picker::intersectAsync(const vsg::dvec3 &start, const vsg::dvec3 &end, std::function<void(const Hit &)> done) const
+{
+    QThreadPool::globalInstance()->start(new FunctionRunnable([this, start, end, done]() { done(intersect(start, end)); }));
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <QThreadPool>
+
+#include <vsg/core/ref_ptr.h>
+#include <vsg/maths/box.h>
+#include <vsg/maths/mat4.h>
+#include <vsg/maths/vec3.h>
+#include <vsg/nodes/Node.h>
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace vsg {
+class VertexIndexDraw;
+}
+
+namespace vsgQt {
+
+// Ray picking against the triangles of the models in a scene. Every mesh gets
+// a bounding volume hierarchy, built on a background thread when its model is
+// added; models are pickable once their hierarchies are done. Meshes are
+// indexed triangle lists of vsg::VertexIndexDraw with vec3 positions in the
+// first array. Instanced draws with a per instance mat4 array in the last
+// array, as made by AutoInstancer, are picked per instance. Of a vsg::LOD
+// only the highest resolution child is picked. A second hierarchy over the
+// world bounds of the meshes and instances of a model finds the ones a ray
+// can hit.
+class Picker
+{
+public:
+
+    struct Hit
+    {
+        bool valid{false};
+        std::vector<vsg::ref_ptr<vsg::Node>> nodePath;
+        vsg::dvec3 worldPosition;
+        // triangle of the draw, and instance for instanced draws
+        uint32_t primitiveIndex{0};
+        uint32_t instanceIndex{0};
+        // along the ray, 0 at start and 1 at end
+        double ratio{0.0};
+        // of the picked mesh, or instance, in world coordinates
+        vsg::dbox bounds;
+    };
+
+    class Bvh;
+    struct Model;
+
+    Picker();
+    ~Picker();
+
+    void add(vsg::ref_ptr<vsg::Node> model);
+    void clear();
+
+    // safe to call from any thread, only blocks while a model is published
+    Hit intersect(const vsg::dvec3 &start, const vsg::dvec3 &end) const;
+
+    // intersect on a thread of the global pool, done is called there
+    void intersectAsync(const vsg::dvec3 &start, const vsg::dvec3 &end, std::function<void(const Hit &)> done) const;
+
+private:
+
+    struct Mesh
+    {
+        std::vector<vsg::ref_ptr<vsg::Node>> nodePath;
+        vsg::dmat4 inverse;
+        vsg::dmat4 matrix;
+        uint32_t instanceIndex{0};
+        std::shared_ptr<const Bvh> bvh;
+    };
+
+    QThreadPool _pool;
+
+    mutable std::mutex _mutex;
+    std::vector<std::shared_ptr<const Model>> _models;
+    uint64_t _generation{0};
+};
+
+}
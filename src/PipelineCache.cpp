@@ -0,0 +1,129 @@
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+
+#include "PipelineCache.h"
+
+#include <QDir>
+#include <QFile>
+#include <QLoggingCategory>
+#include <QSaveFile>
+
+#include <vsg/all.h>
+
+#include <cstring>
+
+namespace {
+static QLoggingCategory lc("pipelinecache");
+
+// the header vkGetPipelineCacheData() writes in front of the data
+struct CacheHeader
+{
+    uint32_t headerSize;
+    uint32_t headerVersion;
+    uint32_t vendorID;
+    uint32_t deviceID;
+    uint8_t uuid[VK_UUID_SIZE];
+};
+
+bool validHeader(const QByteArray &data, const VkPhysicalDeviceProperties &properties)
+{
+    if (static_cast<size_t>(data.size()) < sizeof(CacheHeader))
+        return false;
+
+    CacheHeader header;
+    std::memcpy(&header, data.constData(), sizeof(header));
+
+    return header.headerSize >= sizeof(CacheHeader)
+        && header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+        && header.vendorID == properties.vendorID
+        && header.deviceID == properties.deviceID
+        && std::memcmp(header.uuid, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+}
+
+using namespace vsgQt;
+
+PipelineCache::~PipelineCache()
+{
+    release();
+}
+
+bool PipelineCache::setup(vsg::Device *device, const QString &directory)
+{
+    release();
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(*device->getPhysicalDevice(), &properties);
+
+    QString uuid;
+    for (auto byte : properties.pipelineCacheUUID)
+        uuid += QString("%1").arg(byte, 2, 16, QChar('0'));
+
+    QDir().mkpath(directory);
+    _filename = QDir(directory).filePath(QString("pipelines-%1-%2-%3-%4.bin")
+        .arg(properties.vendorID, 4, 16, QChar('0'))
+        .arg(properties.deviceID, 4, 16, QChar('0'))
+        .arg(properties.driverVersion, 8, 16, QChar('0'))
+        .arg(uuid));
+
+    QByteArray data;
+    if (QFile file(_filename); file.open(QIODevice::ReadOnly))
+    {
+        data = file.readAll();
+        if (!validHeader(data, properties))
+        {
+            qCDebug(lc) << "Discarding stale pipeline cache" << _filename;
+            data.clear();
+        }
+    }
+
+    VkPipelineCacheCreateInfo createInfo = {};
+    createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    createInfo.initialDataSize = static_cast<size_t>(data.size());
+    createInfo.pInitialData = data.isEmpty() ? nullptr : data.constData();
+
+    if (vkCreatePipelineCache(*device, &createInfo, nullptr, &_cache) != VK_SUCCESS)
+    {
+        qCWarning(lc) << "Could not create pipeline cache.";
+        _cache = VK_NULL_HANDLE;
+        return false;
+    }
+
+    qCDebug(lc) << "Pipeline cache" << _filename << "loaded with" << data.size() << "bytes";
+
+    _device = device;
+    return true;
+}
+
+bool PipelineCache::save() const
+{
+    if (_cache == VK_NULL_HANDLE)
+        return false;
+
+    size_t size = 0;
+    if (vkGetPipelineCacheData(*_device, _cache, &size, nullptr) != VK_SUCCESS || size == 0)
+        return false;
+
+    QByteArray data(static_cast<int>(size), Qt::Uninitialized);
+    if (vkGetPipelineCacheData(*_device, _cache, &size, data.data()) != VK_SUCCESS)
+        return false;
+
+    // write a new file and swap it in, a crash never leaves a truncated cache
+    QSaveFile file(_filename);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+
+    file.write(data.constData(), static_cast<qint64>(size));
+    return file.commit();
+}
+
+void PipelineCache::release()
+{
+    if (_cache == VK_NULL_HANDLE)
+        return;
+
+    vkDestroyPipelineCache(*_device, _cache, nullptr);
+    _cache = VK_NULL_HANDLE;
+    _device = {};
+}
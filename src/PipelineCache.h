@@ -0,0 +1,46 @@
+#pragma once
+
+#include <QString>
+
+#include <vsg/core/ref_ptr.h>
+#include <vsg/vk/Device.h>
+
+#include <vulkan/vulkan.h>
+
+namespace vsgQt {
+
+// Persistent VkPipelineCache of a device. The cache file is keyed by vendor,
+// device, driver version and pipeline cache UUID and its header is checked
+// again on load, so caches of another driver are discarded.
+//
+// The vsg version this viewer builds against creates graphics pipelines in
+// GraphicsPipeline::Implementation with VK_NULL_HANDLE as the cache, and its
+// compile Context has no member to carry one. Until it has, handle() is only
+// filled by pipelines created with it explicitly, the scene's pipelines are
+// not cached.
+class PipelineCache
+{
+public:
+
+    PipelineCache() = default;
+    ~PipelineCache();
+
+    PipelineCache(const PipelineCache &) = delete;
+    PipelineCache &operator=(const PipelineCache &) = delete;
+
+    // creates the cache from the file in directory, or an empty one
+    bool setup(vsg::Device *device, const QString &directory);
+    bool save() const;
+    void release();
+
+    VkPipelineCache handle() const { return _cache; }
+    QString filename() const { return _filename; }
+
+private:
+
+    vsg::ref_ptr<vsg::Device> _device;
+    VkPipelineCache _cache{VK_NULL_HANDLE};
+    QString _filename;
+};
+
+}
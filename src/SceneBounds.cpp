@@ -0,0 +1,163 @@
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+
+#include "SceneBounds.h"
+
+#include <vsg/all.h>
+
+#include <algorithm>
+#include <future>
+#include <thread>
+#include <typeinfo>
+
+namespace {
+
+void merge(vsg::dbox &bounds, const vsg::dbox &other)
+{
+    if (other.valid())
+    {
+        bounds.add(other.min);
+        bounds.add(other.max);
+    }
+}
+
+// ComputeBounds, with the vertices of an instanced draw placed by each of the
+// instance matrices in its last array
+class ComputeInstancedBounds : public vsg::ComputeBounds
+{
+public:
+
+    using vsg::ComputeBounds::apply;
+
+    void apply(const vsg::VertexIndexDraw &draw) override
+    {
+        auto matrices = draw.arrays.size() > 1 ? draw.arrays.back().cast<vsg::mat4Array>() : nullptr;
+        if (draw.instanceCount <= 1 || !matrices)
+        {
+            vsg::ComputeBounds::apply(draw);
+            return;
+        }
+
+        vsg::ComputeBounds local;
+        draw.arrays.front()->accept(local);
+        if (!local.bounds.valid())
+            return;
+
+        const auto parent = matrixStack.empty() ? vsg::dmat4() : matrixStack.back();
+        const auto end = std::min(static_cast<size_t>(draw.firstInstance) + draw.instanceCount, matrices->valueCount());
+        for (size_t i = draw.firstInstance; i < end; ++i)
+        {
+            const auto matrix = parent * vsg::dmat4((*matrices)[i]);
+            for (int corner = 0; corner < 8; ++corner)
+            {
+                const vsg::dvec3 point((corner & 1) ? local.bounds.max.x : local.bounds.min.x, (corner & 2) ? local.bounds.max.y : local.bounds.min.y,
+                                       (corner & 4) ? local.bounds.max.z : local.bounds.min.z);
+                bounds.add(matrix * point);
+            }
+        }
+    }
+};
+
+// groups that neither transform nor switch their children
+vsg::Group *plainGroup(vsg::Node *node)
+{
+    const auto &type = typeid(*node);
+    return (type == typeid(vsg::Group) || type == typeid(vsg::StateGroup)) ? static_cast<vsg::Group *>(node) : nullptr;
+}
+
+}
+
+using namespace vsgQt;
+
+vsg::dbox SceneBounds::compute(vsg::Node *node)
+{
+    // step down single child wrappers to where the model branches out
+    auto group = plainGroup(node);
+    while (group && group->getChildren().size() == 1)
+        group = plainGroup(group->getChildren().front());
+
+    const size_t numThreads = std::max(1u, std::thread::hardware_concurrency());
+    if (!group || group->getChildren().size() < 2 || numThreads == 1)
+    {
+        ComputeInstancedBounds computeBounds;
+        node->accept(computeBounds);
+        return computeBounds.bounds;
+    }
+
+    const auto &children = group->getChildren();
+    const size_t numTasks = std::min(numThreads, children.size());
+
+    std::vector<std::future<vsg::dbox>> tasks;
+    for (size_t task = 0; task < numTasks; ++task)
+    {
+        tasks.push_back(std::async(std::launch::async, [&children, task, numTasks]() {
+            ComputeInstancedBounds computeBounds;
+            for (size_t i = task; i < children.size(); i += numTasks)
+                children[i]->accept(computeBounds);
+            return computeBounds.bounds;
+        }));
+    }
+
+    vsg::dbox bounds;
+    for (auto &task : tasks)
+        merge(bounds, task.get());
+    return bounds;
+}
+
+vsg::dbox SceneBounds::prepare(vsg::ref_ptr<vsg::Node> model)
+{
+    const auto bounds = compute(model);
+
+    std::scoped_lock lock(_mutex);
+
+    // models that were never added, cancelled loads, are only referenced here
+    _prepared.erase(std::remove_if(_prepared.begin(), _prepared.end(), [](const std::pair<vsg::ref_ptr<vsg::Node>, vsg::dbox> &prepared) {
+                        return prepared.first->referenceCount() == 1;
+                    }),
+                    _prepared.end());
+
+    _prepared.emplace_back(model, bounds);
+    return bounds;
+}
+
+void SceneBounds::add(vsg::ref_ptr<vsg::Node> model)
+{
+    std::unique_lock lock(_mutex);
+
+    auto itr = std::find_if(_prepared.begin(), _prepared.end(), [&](const std::pair<vsg::ref_ptr<vsg::Node>, vsg::dbox> &prepared) { return prepared.first == model; });
+
+    vsg::dbox bounds;
+    if (itr != _prepared.end())
+    {
+        bounds = itr->second;
+        _prepared.erase(itr);
+    }
+    else
+    {
+        lock.unlock();
+        bounds = compute(model);
+        lock.lock();
+    }
+
+    _models.emplace_back(model, bounds);
+    merge(_bounds, bounds);
+}
+
+void SceneBounds::remove(const vsg::Node *model)
+{
+    std::scoped_lock lock(_mutex);
+
+    _models.erase(std::remove_if(_models.begin(), _models.end(), [&](const std::pair<vsg::ref_ptr<vsg::Node>, vsg::dbox> &entry) { return entry.first.get() == model; }),
+                  _models.end());
+
+    _bounds = {};
+    for (auto &entry : _models)
+        merge(_bounds, entry.second);
+}
+
+vsg::dbox SceneBounds::bounds() const
+{
+    std::scoped_lock lock(_mutex);
+    return _bounds;
+}
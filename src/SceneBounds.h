@@ -0,0 +1,42 @@
+#pragma once
+
+#include <vsg/core/ref_ptr.h>
+#include <vsg/maths/box.h>
+#include <vsg/nodes/Node.h>
+
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace vsgQt {
+
+// Bounds of the models of a scene, kept per model so adding or removing one
+// only costs that model. The bounds of a model can be prepared on the thread
+// that loads it, before it is added to the scene.
+class SceneBounds
+{
+public:
+
+    // ComputeBounds of node, with the instances of instanced draws, split
+    // over threads below its plain groups
+    static vsg::dbox compute(vsg::Node *node);
+
+    // computes and keeps the bounds of a model about to be added
+    vsg::dbox prepare(vsg::ref_ptr<vsg::Node> model);
+
+    // uses the prepared bounds, or computes them when there are none
+    void add(vsg::ref_ptr<vsg::Node> model);
+    void remove(const vsg::Node *model);
+
+    // union of the bounds of all models
+    vsg::dbox bounds() const;
+
+private:
+
+    mutable std::mutex _mutex;
+    std::vector<std::pair<vsg::ref_ptr<vsg::Node>, vsg::dbox>> _prepared;
+    std::vector<std::pair<vsg::ref_ptr<vsg::Node>, vsg::dbox>> _models;
+    vsg::dbox _bounds;
+};
+
+}
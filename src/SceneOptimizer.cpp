@@ -0,0 +1,720 @@
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+
+#include "SceneOptimizer.h"
+#include "SceneStats.h"
+
+#include <QByteArray>
+#include <QCryptographicHash>
+
+#include <vsg/all.h>
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <sstream>
+#include <typeinfo>
+
+namespace {
+
+// draws with more vertices are left as they are, merged draws stay below the batch size
+constexpr size_t MaxMergeVertices = 1 << 16;
+constexpr size_t MaxBatchVertices = 1 << 20;
+
+// state commands that bind the same pipeline, layouts, descriptors and data
+// get the same key, data is hashed by content once per array
+class ShareStateCommands : public vsg::Visitor
+{
+public:
+
+    void apply(vsg::Object &object) override
+    {
+        object.traverse(*this);
+    }
+
+    void apply(vsg::StateGroup &stateGroup) override
+    {
+        for (auto &command : stateGroup.getStateCommands())
+        {
+            auto &shared = _shared[key(command)];
+            if (!shared)
+                shared = command;
+            else if (shared != command)
+            {
+                command = shared;
+                ++replaced;
+            }
+        }
+
+        stateGroup.traverse(*this);
+    }
+
+    uint32_t replaced{0};
+
+private:
+
+    const QByteArray &key(const vsg::ref_ptr<vsg::StateCommand> &command)
+    {
+        auto &result = _keys[command.get()];
+        if (!result.isEmpty())
+            return result;
+
+        QCryptographicHash hash(QCryptographicHash::Sha1);
+        addString(hash, typeid(*command).name());
+        addValue(hash, command->slot);
+
+        if (auto bind = command->cast<vsg::BindGraphicsPipeline>())
+        {
+            addPipeline(hash, bind->pipeline.get());
+        }
+        else if (auto bind = command->cast<vsg::BindDescriptorSet>())
+        {
+            addValue(hash, bind->pipelineBindPoint);
+            addValue(hash, bind->firstSet);
+            addLayout(hash, bind->layout.get());
+            addDescriptorSet(hash, bind->descriptorSet.get());
+        }
+        else if (auto bind = command->cast<vsg::BindDescriptorSets>())
+        {
+            addValue(hash, bind->pipelineBindPoint);
+            addValue(hash, bind->firstSet);
+            addLayout(hash, bind->layout.get());
+            for (auto &descriptorSet : bind->descriptorSets)
+                addDescriptorSet(hash, descriptorSet.get());
+        }
+        else if (auto pushConstants = command->cast<vsg::PushConstants>())
+        {
+            addValue(hash, pushConstants->stageFlags);
+            addValue(hash, pushConstants->offset);
+            addData(hash, pushConstants->value.get());
+        }
+        else
+        {
+            // commands this does not know are only shared with themselves
+            addPointer(hash, command.get());
+        }
+
+        result = hash.result();
+        return result;
+    }
+
+    template<typename T>
+    static void addValue(QCryptographicHash &hash, const T &value)
+    {
+        hash.addData(reinterpret_cast<const char *>(&value), sizeof(value));
+    }
+
+    static void addString(QCryptographicHash &hash, const std::string &text)
+    {
+        hash.addData(text.data(), static_cast<int>(text.size()) + 1);
+    }
+
+    static void addPointer(QCryptographicHash &hash, const void *pointer)
+    {
+        addValue(hash, reinterpret_cast<quintptr>(pointer));
+    }
+
+    // small objects without data, such as pipeline states and samplers
+    static void addSerialized(QCryptographicHash &hash, const vsg::Object *object)
+    {
+        if (!object)
+        {
+            addPointer(hash, nullptr);
+            return;
+        }
+
+        std::ostringstream stream;
+        vsg::VSG().write(vsg::ref_ptr<const vsg::Object>(object), stream);
+        addString(hash, stream.str());
+    }
+
+    void addData(QCryptographicHash &hash, const vsg::Data *data)
+    {
+        if (!data)
+        {
+            addPointer(hash, nullptr);
+            return;
+        }
+
+        auto &content = _contents[data];
+        if (content.isEmpty())
+        {
+            QCryptographicHash dataHash(QCryptographicHash::Sha1);
+            addString(dataHash, typeid(*data).name());
+            const uint32_t dimensions[] = {data->width(), data->height(), data->depth(), static_cast<uint32_t>(data->getLayout().format)};
+            dataHash.addData(reinterpret_cast<const char *>(dimensions), sizeof(dimensions));
+            dataHash.addData(static_cast<const char *>(data->dataPointer()), static_cast<int>(data->dataSize()));
+            content = dataHash.result();
+        }
+        hash.addData(content);
+    }
+
+    static void addLayout(QCryptographicHash &hash, const vsg::DescriptorSetLayout *layout)
+    {
+        if (!layout)
+        {
+            addPointer(hash, nullptr);
+            return;
+        }
+
+        // immutable sampler pointers are left out
+        for (auto &binding : layout->bindings)
+        {
+            addValue(hash, binding.binding);
+            addValue(hash, binding.descriptorType);
+            addValue(hash, binding.descriptorCount);
+            addValue(hash, binding.stageFlags);
+        }
+    }
+
+    static void addLayout(QCryptographicHash &hash, const vsg::PipelineLayout *layout)
+    {
+        if (!layout)
+        {
+            addPointer(hash, nullptr);
+            return;
+        }
+
+        addValue(hash, layout->flags);
+        for (auto &setLayout : layout->setLayouts)
+            addLayout(hash, setLayout.get());
+        for (auto &range : layout->pushConstantRanges)
+        {
+            addValue(hash, range.stageFlags);
+            addValue(hash, range.offset);
+            addValue(hash, range.size);
+        }
+    }
+
+    void addPipeline(QCryptographicHash &hash, const vsg::GraphicsPipeline *pipeline)
+    {
+        if (!pipeline)
+        {
+            addPointer(hash, nullptr);
+            return;
+        }
+
+        addLayout(hash, pipeline->layout.get());
+        addValue(hash, pipeline->subpass);
+
+        for (auto &stage : pipeline->stages)
+        {
+            addValue(hash, stage->stage);
+            addString(hash, stage->entryPointName);
+            if (stage->module)
+            {
+                addString(hash, stage->module->source);
+                hash.addData(reinterpret_cast<const char *>(stage->module->code.data()), static_cast<int>(stage->module->code.size() * sizeof(uint32_t)));
+            }
+            for (auto &[id, value] : stage->specializationConstants)
+            {
+                addValue(hash, id);
+                addData(hash, value.get());
+            }
+        }
+
+        for (auto &state : pipeline->pipelineStates)
+            addSerialized(hash, state.get());
+    }
+
+    void addDescriptorSet(QCryptographicHash &hash, const vsg::DescriptorSet *descriptorSet)
+    {
+        if (!descriptorSet)
+        {
+            addPointer(hash, nullptr);
+            return;
+        }
+
+        addLayout(hash, descriptorSet->setLayout.get());
+        for (auto &descriptor : descriptorSet->descriptors)
+        {
+            addString(hash, typeid(*descriptor).name());
+            addValue(hash, descriptor->dstBinding);
+            addValue(hash, descriptor->dstArrayElement);
+            addValue(hash, descriptor->descriptorType);
+
+            if (auto image = descriptor->cast<vsg::DescriptorImage>())
+            {
+                for (auto &imageInfo : image->imageInfoList)
+                {
+                    addSerialized(hash, imageInfo ? imageInfo->sampler.get() : nullptr);
+                    const bool hasData = imageInfo && imageInfo->imageView && imageInfo->imageView->image;
+                    addData(hash, hasData ? imageInfo->imageView->image->data.get() : nullptr);
+                    if (imageInfo)
+                        addValue(hash, imageInfo->imageLayout);
+                }
+            }
+            else if (auto buffer = descriptor->cast<vsg::DescriptorBuffer>())
+            {
+                for (auto &bufferInfo : buffer->bufferInfoList)
+                    addData(hash, bufferInfo ? bufferInfo->data.get() : nullptr);
+            }
+            else
+            {
+                addPointer(hash, descriptor.get());
+            }
+        }
+    }
+
+    std::map<const vsg::StateCommand *, QByteArray> _keys;
+    std::map<const vsg::Data *, QByteArray> _contents;
+    std::map<QByteArray, vsg::ref_ptr<vsg::StateCommand>> _shared;
+};
+
+// parents of every node below groups, an edge of a shared subtree counts once
+class CountParents : public vsg::Visitor
+{
+public:
+
+    void apply(vsg::Object &object) override
+    {
+        object.traverse(*this);
+    }
+
+    void apply(vsg::Group &group) override
+    {
+        for (auto &child : group.getChildren())
+        {
+            if (++parents[child.get()] == 1)
+                child->accept(*this);
+        }
+    }
+
+    bool shared(const vsg::Node *node) const
+    {
+        auto itr = parents.find(node);
+        return itr != parents.end() && itr->second > 1;
+    }
+
+    std::map<const vsg::Node *, uint32_t> parents;
+};
+
+class MergeStateGroups : public vsg::Visitor
+{
+public:
+
+    explicit MergeStateGroups(const CountParents &parents) : _parents(parents) {}
+
+    void apply(vsg::Object &object) override
+    {
+        object.traverse(*this);
+    }
+
+    void apply(vsg::Group &group) override
+    {
+        // a shared subtree is changed once, for all its parents
+        if (!_visited.insert(&group).second)
+            return;
+
+        auto &children = group.getChildren();
+
+        // later siblings move their children into the first StateGroup with the same state
+        std::map<vsg::StateGroup::StateCommands, vsg::StateGroup *> first;
+        vsg::Group::Children kept;
+        for (auto &child : children)
+        {
+            // other parents of a shared StateGroup would draw what is moved into it
+            auto stateGroup = child->cast<vsg::StateGroup>();
+            if (stateGroup && typeid(*stateGroup) == typeid(vsg::StateGroup) && !_parents.shared(stateGroup))
+            {
+                auto &target = first[stateGroup->getStateCommands()];
+                if (target)
+                {
+                    for (auto &grandChild : stateGroup->getChildren())
+                        target->addChild(grandChild);
+                    ++merged;
+                    continue;
+                }
+                target = stateGroup;
+            }
+            kept.push_back(child);
+        }
+        children = kept;
+
+        group.traverse(*this);
+    }
+
+    uint32_t merged{0};
+
+private:
+    const CountParents &_parents;
+    std::set<const vsg::Group *> _visited;
+};
+
+template<class A>
+vsg::ref_ptr<vsg::Data> concatenate(const std::vector<vsg::Data *> &arrays)
+{
+    size_t count = 0;
+    for (auto array : arrays)
+        count += array->valueCount();
+
+    auto result = A::create(static_cast<uint32_t>(count));
+    auto itr = result->begin();
+    for (auto array : arrays)
+    {
+        auto typed = static_cast<A *>(array);
+        itr = std::copy(typed->begin(), typed->end(), itr);
+    }
+    return result;
+}
+
+vsg::ref_ptr<vsg::Data> concatenateArrays(const std::vector<vsg::Data *> &arrays)
+{
+    auto first = arrays.front();
+    if (first->cast<vsg::vec2Array>()) return concatenate<vsg::vec2Array>(arrays);
+    if (first->cast<vsg::vec3Array>()) return concatenate<vsg::vec3Array>(arrays);
+    if (first->cast<vsg::vec4Array>()) return concatenate<vsg::vec4Array>(arrays);
+    if (first->cast<vsg::ubvec4Array>()) return concatenate<vsg::ubvec4Array>(arrays);
+    if (first->cast<vsg::floatArray>()) return concatenate<vsg::floatArray>(arrays);
+    return {};
+}
+
+bool readIndices(const vsg::VertexIndexDraw &draw, std::vector<uint32_t> &indices)
+{
+    auto read = [&](auto &array) {
+        if (draw.firstIndex + draw.indexCount > array.valueCount())
+            return false;
+
+        for (uint32_t i = draw.firstIndex; i < draw.firstIndex + draw.indexCount; ++i)
+            indices.push_back(static_cast<uint32_t>(static_cast<int64_t>(array[i]) + draw.vertexOffset));
+        return true;
+    };
+
+    if (!draw.indices || draw.indexCount % 3 != 0)
+        return false;
+    if (auto array = draw.indices.cast<vsg::ushortArray>())
+        return read(*array);
+    if (auto array = draw.indices.cast<vsg::uintArray>())
+        return read(*array);
+    return false;
+}
+
+vsg::ref_ptr<vsg::Data> createIndices(const std::vector<uint32_t> &indices, uint32_t numVertices)
+{
+    if (numVertices <= 0xffff)
+    {
+        auto array = vsg::ushortArray::create(static_cast<uint32_t>(indices.size()));
+        std::transform(indices.begin(), indices.end(), array->begin(), [](uint32_t index) { return static_cast<uint16_t>(index); });
+        return array;
+    }
+
+    auto array = vsg::uintArray::create(static_cast<uint32_t>(indices.size()));
+    std::copy(indices.begin(), indices.end(), array->begin());
+    return array;
+}
+
+// the vertex arrays of a draw, if they are all per vertex and the draw is not instanced
+bool mergeable(const vsg::VertexIndexDraw &draw)
+{
+    if (draw.arrays.empty() || draw.instanceCount != 1 || draw.firstInstance != 0 || !draw.indices || draw.indexCount % 3 != 0)
+        return false;
+
+    const auto numVertices = draw.arrays.front()->valueCount();
+    if (numVertices > MaxMergeVertices)
+        return false;
+
+    return std::all_of(draw.arrays.begin(), draw.arrays.end(), [&](const vsg::ref_ptr<vsg::Data> &array) { return array->valueCount() == numVertices; });
+}
+
+// arrays of the same types in the same order can share buffers
+std::vector<const std::type_info *> layout(const vsg::VertexIndexDraw &draw)
+{
+    std::vector<const std::type_info *> types;
+    for (auto &array : draw.arrays)
+        types.push_back(&typeid(*array));
+    return types;
+}
+
+class MergeDraws : public vsg::Visitor
+{
+public:
+
+    explicit MergeDraws(const CountParents &parents) : _parents(parents) {}
+
+    void apply(vsg::Object &object) override
+    {
+        object.traverse(*this);
+    }
+
+    void apply(vsg::Group &group) override
+    {
+        if (!_visited.insert(&group).second)
+            return;
+
+        auto &children = group.getChildren();
+
+        // only runs of adjacent draws are merged, each in place of its first
+        // draw, so no draw moves past a sibling command that changes state
+        std::vector<vsg::VertexIndexDraw *> run;
+        vsg::Group::Children kept;
+        for (auto &child : children)
+        {
+            // a shared draw stays one draw, it is only reordered once
+            auto draw = child->cast<vsg::VertexIndexDraw>();
+            if (draw && mergeable(*draw) && !_parents.shared(draw))
+            {
+                if (!run.empty() && (layout(*run.front()) != layout(*draw) || run.front()->firstBinding != draw->firstBinding || vertexCount(run) + draw->arrays.front()->valueCount() > MaxBatchVertices))
+                    flush(run, kept);
+
+                run.push_back(draw);
+                continue;
+            }
+
+            flush(run, kept);
+            kept.push_back(draw ? optimized(*draw) : child);
+        }
+        flush(run, kept);
+
+        children = kept;
+
+        group.traverse(*this);
+    }
+
+    uint32_t merged{0};
+
+private:
+
+    static size_t vertexCount(const std::vector<vsg::VertexIndexDraw *> &batch)
+    {
+        size_t count = 0;
+        for (auto draw : batch)
+            count += draw->arrays.front()->valueCount();
+        return count;
+    }
+
+    void flush(std::vector<vsg::VertexIndexDraw *> &run, vsg::Group::Children &kept)
+    {
+        if (run.empty())
+            return;
+
+        if (run.size() == 1)
+        {
+            kept.push_back(optimized(*run.front()));
+        }
+        else if (auto draw = merge(run))
+        {
+            kept.push_back(draw);
+            merged += static_cast<uint32_t>(run.size());
+        }
+        else
+        {
+            for (auto original : run)
+                kept.push_back(vsg::ref_ptr<vsg::Node>(original));
+        }
+
+        run.clear();
+    }
+
+    static vsg::ref_ptr<vsg::Node> merge(const std::vector<vsg::VertexIndexDraw *> &batch)
+    {
+        const auto numArrays = batch.front()->arrays.size();
+
+        vsg::DataList arrays;
+        for (size_t i = 0; i < numArrays; ++i)
+        {
+            std::vector<vsg::Data *> sources;
+            for (auto draw : batch)
+                sources.push_back(draw->arrays[i]);
+
+            auto array = concatenateArrays(sources);
+            if (!array)
+                return {};
+            arrays.push_back(array);
+        }
+
+        std::vector<uint32_t> indices;
+        uint32_t base = 0;
+        for (auto draw : batch)
+        {
+            std::vector<uint32_t> drawIndices;
+            if (!readIndices(*draw, drawIndices))
+                return {};
+
+            for (auto index : drawIndices)
+                indices.push_back(index + base);
+
+            base += static_cast<uint32_t>(draw->arrays.front()->valueCount());
+        }
+
+        return create(arrays, indices, base, batch.front()->firstBinding);
+    }
+
+    // the same draw with its indices reordered, once for all parents of the draw
+    vsg::ref_ptr<vsg::Node> optimized(vsg::VertexIndexDraw &draw)
+    {
+        auto &result = _optimized[&draw];
+        if (result)
+            return result;
+
+        std::vector<uint32_t> indices;
+        if (draw.arrays.empty() || !readIndices(draw, indices))
+        {
+            result = vsg::ref_ptr<vsg::Node>(&draw);
+            return result;
+        }
+
+        auto reordered = create(draw.arrays, indices, static_cast<uint32_t>(draw.arrays.front()->valueCount()), draw.firstBinding);
+        reordered->instanceCount = draw.instanceCount;
+        reordered->firstInstance = draw.firstInstance;
+        result = reordered;
+        return result;
+    }
+
+    const CountParents &_parents;
+    std::set<const vsg::Group *> _visited;
+    std::map<const vsg::VertexIndexDraw *, vsg::ref_ptr<vsg::Node>> _optimized;
+
+    // arrays stay bound from the same vertex input binding as in the source draws
+    static vsg::ref_ptr<vsg::VertexIndexDraw> create(const vsg::DataList &arrays, const std::vector<uint32_t> &indices, uint32_t numVertices, uint32_t firstBinding)
+    {
+        auto draw = vsg::VertexIndexDraw::create();
+        draw->firstBinding = firstBinding;
+        draw->arrays = arrays;
+        draw->indices = createIndices(vsgQt::SceneOptimizer::reorderForVertexCache(indices, numVertices), numVertices);
+        draw->indexCount = static_cast<uint32_t>(indices.size());
+        draw->instanceCount = 1;
+        return draw;
+    }
+};
+
+}
+
+using namespace vsgQt;
+
+SceneOptimizer::Stats SceneOptimizer::collectStats(vsg::Node *node)
+{
+    const auto counters = SceneStats::collect(node);
+
+    Stats stats;
+    stats.drawCalls = static_cast<uint32_t>(counters.drawCalls);
+    stats.stateBinds = static_cast<uint32_t>(counters.pipelineBinds + counters.descriptorBinds);
+    return stats;
+}
+
+SceneOptimizer::Report SceneOptimizer::apply(vsg::Node *node) const
+{
+    Report report;
+    report.before = collectStats(node);
+
+    ShareStateCommands share;
+    node->accept(share);
+    report.sharedStateCommands = share.replaced;
+
+    CountParents parents;
+    node->accept(parents);
+
+    MergeStateGroups mergeStateGroups(parents);
+    node->accept(mergeStateGroups);
+    report.mergedStateGroups = mergeStateGroups.merged;
+
+    // merging StateGroups moved children, but added no parents to shared nodes
+    MergeDraws mergeDraws(parents);
+    node->accept(mergeDraws);
+    report.mergedDraws = mergeDraws.merged;
+
+    report.after = collectStats(node);
+    return report;
+}
+
+std::vector<uint32_t> SceneOptimizer::reorderForVertexCache(const std::vector<uint32_t> &indices, uint32_t numVertices, uint32_t cacheSize)
+{
+    const size_t numTriangles = indices.size() / 3;
+    if (numTriangles == 0 || numVertices == 0)
+        return indices;
+
+    if (std::any_of(indices.begin(), indices.end(), [&](uint32_t index) { return index >= numVertices; }))
+        return indices;
+
+    // triangles around every vertex
+    std::vector<uint32_t> offsets(numVertices + 1, 0);
+    for (auto index : indices)
+        ++offsets[index + 1];
+    for (uint32_t v = 0; v < numVertices; ++v)
+        offsets[v + 1] += offsets[v];
+
+    std::vector<uint32_t> adjacency(numTriangles * 3);
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t t = 0; t < numTriangles; ++t)
+    {
+        for (size_t k = 0; k < 3; ++k)
+            adjacency[fill[indices[t * 3 + k]]++] = static_cast<uint32_t>(t);
+    }
+
+    std::vector<uint32_t> liveTriangles(numVertices);
+    for (uint32_t v = 0; v < numVertices; ++v)
+        liveTriangles[v] = offsets[v + 1] - offsets[v];
+
+    std::vector<uint32_t> cacheTime(numVertices, 0);
+    std::vector<bool> emitted(numTriangles, false);
+    std::vector<uint32_t> deadEnd;
+    std::vector<uint32_t> output;
+    output.reserve(indices.size());
+
+    uint32_t time = cacheSize + 1;
+    uint32_t cursor = 1;
+    int64_t fanning = 0;
+
+    while (fanning >= 0)
+    {
+        // emit all triangles around the fanning vertex
+        std::vector<uint32_t> candidates;
+        for (uint32_t i = offsets[fanning]; i < offsets[fanning + 1]; ++i)
+        {
+            const auto t = adjacency[i];
+            if (emitted[t])
+                continue;
+
+            for (size_t k = 0; k < 3; ++k)
+            {
+                const auto v = indices[t * 3 + k];
+                output.push_back(v);
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                --liveTriangles[v];
+
+                if (time - cacheTime[v] > cacheSize)
+                    cacheTime[v] = time++;
+            }
+            emitted[t] = true;
+        }
+
+        // continue with the candidate that stays longest in the cache
+        fanning = -1;
+        int64_t best = -1;
+        for (auto v : candidates)
+        {
+            if (liveTriangles[v] == 0)
+                continue;
+
+            int64_t priority = 0;
+            if (time - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize)
+                priority = time - cacheTime[v];
+
+            if (priority > best)
+            {
+                best = priority;
+                fanning = v;
+            }
+        }
+
+        // dead end, go back to recently used vertices, then scan for any left
+        while (fanning < 0 && !deadEnd.empty())
+        {
+            const auto v = deadEnd.back();
+            deadEnd.pop_back();
+            if (liveTriangles[v] > 0)
+                fanning = v;
+        }
+
+        if (fanning < 0)
+        {
+            while (cursor < numVertices && liveTriangles[cursor] == 0)
+                ++cursor;
+            if (cursor < numVertices)
+                fanning = cursor;
+        }
+    }
+
+    return output;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <vsg/core/ref_ptr.h>
+#include <vsg/nodes/Node.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace vsgQt {
+
+// Optimizes a freshly loaded model before it is compiled:
+//  - state commands with identical content are shared,
+//  - sibling StateGroups with the same state are merged into one,
+//  - runs of adjacent small VertexIndexDraws are merged into larger
+//    vertex and index arrays, in place of the first draw of the run,
+//  - indices are reordered for the post-transform vertex cache.
+class SceneOptimizer
+{
+public:
+
+    struct Stats
+    {
+        uint32_t drawCalls{0};
+        uint32_t stateBinds{0};
+    };
+
+    struct Report
+    {
+        Stats before;
+        Stats after;
+        uint32_t sharedStateCommands{0};
+        uint32_t mergedStateGroups{0};
+        uint32_t mergedDraws{0};
+    };
+
+    Report apply(vsg::Node *node) const;
+
+    // draw calls and pipeline and descriptor set binds when node is recorded
+    // once, as SceneStats counts them
+    static Stats collectStats(vsg::Node *node);
+
+    // Tipsify (Sander, Nehab, Barczak 2007) for a triangle list
+    static std::vector<uint32_t> reorderForVertexCache(const std::vector<uint32_t> &indices, uint32_t numVertices, uint32_t cacheSize = 16);
+};
+
+}
@@ -0,0 +1,78 @@
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+
+#include "SceneSetup.h"
+
+#include <vsg/all.h>
+
+#include <algorithm>
+#include <typeinfo>
+
+namespace {
+
+// the depth buffer resolves no more than this far/near ratio
+constexpr double MaxFarNearRatio = 1.0e4;
+
+}
+
+vsg::ref_ptr<vsg::Node> vsgQt::readStartupModel()
+{
+    vsg::Paths searchPaths = vsg::getEnvPaths("VSG_FILE_PATH");
+    vsg::Path filename = vsg::findFile("models/teapot.vsgt", searchPaths);
+    return vsg::read_cast<vsg::Node>(filename);
+}
+
+vsgQt::CameraSetup vsgQt::createCamera(const vsg::dbox &bounds, vsg::Object *scene, const VkExtent2D &extent, const vsg::dvec3 &eyeDirection, const vsg::dvec3 &up)
+{
+    vsg::dvec3 centre = (bounds.min+bounds.max)*0.5;
+    double radius = vsg::length(bounds.max-bounds.min)*0.6;
+    double nearFarRatio = 0.001;
+    double aspectRatio = static_cast<double>(extent.width) / static_cast<double>(extent.height);
+
+    CameraSetup setup;
+    setup.lookAt = vsg::LookAt::create(centre+vsg::normalize(eyeDirection)*(radius*3.5), centre, up);
+
+    if (vsg::ref_ptr<vsg::EllipsoidModel> ellipsoidModel(scene->getObject<vsg::EllipsoidModel>("EllipsoidModel")); ellipsoidModel)
+    {
+        setup.projection = vsg::EllipsoidPerspective::create(setup.lookAt, ellipsoidModel, 30.0, aspectRatio, nearFarRatio, 0.0);
+    }
+    else
+    {
+        setup.projection = vsg::Perspective::create(30.0, aspectRatio, nearFarRatio*radius, radius * 4.5);
+    }
+
+    setup.viewport = vsg::ViewportState::create(extent);
+    setup.camera = vsg::Camera::create(setup.projection, setup.lookAt, setup.viewport);
+
+    return setup;
+}
+
+void vsgQt::frameBounds(const vsg::dbox &bounds, const vsg::dbox &scene, vsg::LookAt *lookAt, vsg::ProjectionMatrix *projection)
+{
+    if (!bounds.valid())
+        return;
+
+    vsg::dvec3 centre = (bounds.min+bounds.max)*0.5;
+    double radius = vsg::length(bounds.max-bounds.min)*0.6;
+    double nearFarRatio = 0.001;
+
+    auto direction = lookAt->eye - lookAt->center;
+    if (vsg::length(direction) == 0.0)
+        direction.set(0.0, -1.0, 0.0);
+
+    lookAt->center = centre;
+    lookAt->eye = centre+vsg::normalize(direction)*(radius*3.5);
+
+    // the rest of the scene stays inside the far plane
+    if (auto perspective = dynamic_cast<vsg::Perspective *>(projection); perspective && typeid(*perspective) == typeid(vsg::Perspective))
+    {
+        double farDistance = radius * 4.5;
+        if (scene.valid())
+            farDistance = std::max(farDistance, vsg::length(lookAt->eye - (scene.min+scene.max)*0.5) + vsg::length(scene.max-scene.min)*0.5);
+
+        // a small selection in a large scene moves near out before far
+        perspective->nearDistance = std::max(nearFarRatio*radius, farDistance / MaxFarNearRatio);
+        perspective->farDistance = farDistance;
+    }
+}
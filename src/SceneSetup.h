@@ -0,0 +1,34 @@
+#pragma once
+
+#include <vsg/core/ref_ptr.h>
+#include <vsg/maths/box.h>
+#include <vsg/nodes/Node.h>
+#include <vsg/viewer/Camera.h>
+
+#include <vulkan/vulkan.h>
+
+namespace vsgQt {
+
+// The camera set up shared by the viewer and the headless benchmark.
+struct CameraSetup
+{
+    vsg::ref_ptr<vsg::LookAt> lookAt;
+    vsg::ref_ptr<vsg::ProjectionMatrix> projection;
+    vsg::ref_ptr<vsg::ViewportState> viewport;
+    vsg::ref_ptr<vsg::Camera> camera;
+};
+
+// reads models/teapot.vsgt from VSG_FILE_PATH
+vsg::ref_ptr<vsg::Node> readStartupModel();
+
+// looks at bounds from eyeDirection, -Y with Z up by default, scene is checked
+// for an EllipsoidModel
+CameraSetup createCamera(const vsg::dbox &bounds, vsg::Object *scene, const VkExtent2D &extent,
+                         const vsg::dvec3 &eyeDirection = {0.0, -1.0, 0.0}, const vsg::dvec3 &up = {0.0, 0.0, 1.0});
+
+// moves lookAt along its view direction so bounds fill the view as with
+// createCamera, and fits near and far of a vsg::Perspective to scene, with
+// near moved out as far as the depth buffer needs
+void frameBounds(const vsg::dbox &bounds, const vsg::dbox &scene, vsg::LookAt *lookAt, vsg::ProjectionMatrix *projection);
+
+}
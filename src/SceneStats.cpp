@@ -0,0 +1,335 @@
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+
+#include "SceneStats.h"
+
+#include <vsg/all.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace {
+
+VkPrimitiveTopology topologyOf(const vsg::BindGraphicsPipeline *bind)
+{
+    if (bind && bind->pipeline)
+    {
+        for (auto &state : bind->pipeline->pipelineStates)
+        {
+            if (auto inputAssembly = state.cast<vsg::InputAssemblyState>())
+                return inputAssembly->topology;
+        }
+    }
+
+    return VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+}
+
+uint64_t primitiveCount(VkPrimitiveTopology topology, uint64_t indexCount)
+{
+    switch (topology)
+    {
+    case VK_PRIMITIVE_TOPOLOGY_POINT_LIST: return indexCount;
+    case VK_PRIMITIVE_TOPOLOGY_LINE_LIST: return indexCount / 2;
+    case VK_PRIMITIVE_TOPOLOGY_LINE_STRIP: return indexCount > 1 ? indexCount - 1 : 0;
+    case VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP:
+    case VK_PRIMITIVE_TOPOLOGY_TRIANGLE_FAN: return indexCount > 2 ? indexCount - 2 : 0;
+    default: return indexCount / 3;
+    }
+}
+
+class CollectCounters : public vsg::Visitor
+{
+public:
+
+    CollectCounters(const vsg::dmat4 &projection, const vsg::dmat4 &view)
+        : _projection(projection)
+        , _cull(true)
+    {
+        pushModelView(view);
+    }
+
+    CollectCounters()
+    {
+        pushModelView(vsg::dmat4());
+    }
+
+    vsgQt::SceneStats::Counters counters;
+
+    void apply(vsg::Object &object) override
+    {
+        object.traverse(*this);
+    }
+
+    void apply(vsg::MatrixTransform &transform) override
+    {
+        pushModelView(_frames.back().modelView * transform.matrix);
+        transform.traverse(*this);
+        _frames.pop_back();
+    }
+
+    void apply(vsg::CullGroup &cullGroup) override
+    {
+        if (visible(cullGroup.bound))
+            cullGroup.traverse(*this);
+        else
+            ++counters.culledNodes;
+    }
+
+    void apply(vsg::CullNode &cullNode) override
+    {
+        if (visible(cullNode.bound))
+            cullNode.traverse(*this);
+        else
+            ++counters.culledNodes;
+    }
+
+    void apply(vsg::LOD &lod) override
+    {
+        if (!visible(lod.bound))
+        {
+            ++counters.culledNodes;
+            return;
+        }
+
+        if (!_cull)
+        {
+            lod.traverse(*this);
+            return;
+        }
+
+        // the first child whose ratio the bound exceeds on screen
+        const auto ratio = screenHeightRatio(lod.bound);
+        for (auto &child : lod.getChildren())
+        {
+            if (ratio > child.minimumScreenHeightRatio)
+            {
+                if (child.node)
+                    child.node->accept(*this);
+                return;
+            }
+        }
+    }
+
+    void apply(vsg::PagedLOD &plod) override
+    {
+        if (!visible(plod.bound))
+        {
+            ++counters.culledNodes;
+            return;
+        }
+
+        if (!_cull)
+        {
+            plod.traverse(*this);
+            return;
+        }
+
+        // a high resolution tile that is not loaded yet shows the next child
+        const auto ratio = screenHeightRatio(plod.bound);
+        for (auto &child : plod.getChildren())
+        {
+            if (ratio > child.minimumScreenHeightRatio && child.node)
+            {
+                child.node->accept(*this);
+                return;
+            }
+        }
+    }
+
+    void apply(vsg::Switch &switchNode) override
+    {
+        // hidden children are not recorded
+        for (auto &child : switchNode.getChildren())
+        {
+            if (child.enabled && child.node)
+                child.node->accept(*this);
+        }
+    }
+
+    void apply(vsg::StateGroup &stateGroup) override
+    {
+        const auto &stateCommands = stateGroup.getStateCommands();
+        for (auto &stateCommand : stateCommands)
+            push(stateCommand);
+
+        stateGroup.traverse(*this);
+
+        for (auto &stateCommand : stateCommands)
+            pop(stateCommand);
+    }
+
+    void apply(vsg::BindGraphicsPipeline &bind) override
+    {
+        // recorded where it is, outside of a StateGroup
+        ++counters.pipelineBinds;
+        _topology = topologyOf(&bind);
+    }
+
+    void apply(vsg::Draw &) override
+    {
+        recordState();
+        ++counters.drawCalls;
+    }
+
+    void apply(vsg::DrawIndexed &draw) override
+    {
+        recordState();
+        ++counters.drawCalls;
+        counters.indexedPrimitives += primitiveCount(_topology, draw.indexCount) * draw.instanceCount;
+    }
+
+    void apply(vsg::VertexIndexDraw &draw) override
+    {
+        recordState();
+        ++counters.drawCalls;
+        counters.indexedPrimitives += primitiveCount(_topology, draw.indexCount) * draw.instanceCount;
+    }
+
+private:
+
+    struct Frame
+    {
+        vsg::dmat4 modelView;
+        // left, right, bottom and top, the planes vsg culls against
+        std::array<vsg::dvec4, 4> planes;
+        double scale;
+    };
+
+    // state commands of one slot, bound again before the next draw once the top changed
+    struct Slot
+    {
+        std::vector<vsg::StateCommand *> stack;
+        bool dirty{false};
+    };
+
+    void pushModelView(const vsg::dmat4 &modelView)
+    {
+        Frame frame;
+        frame.modelView = modelView;
+
+        // clip space planes of projection * modelView, in model coordinates
+        const auto m = _projection * modelView;
+        auto row = [&](int r) { return vsg::dvec4(m[0][r], m[1][r], m[2][r], m[3][r]); };
+        const auto w = row(3);
+        frame.planes = {w + row(0), w - row(0), w + row(1), w - row(1)};
+        for (auto &plane : frame.planes)
+        {
+            const auto length = vsg::length(vsg::dvec3(plane.x, plane.y, plane.z));
+            if (length > 0.0)
+                plane = plane / length;
+        }
+
+        // radii scale with the largest axis of the model to eye transform
+        frame.scale = std::max({vsg::length(vsg::dvec3(modelView[0][0], modelView[0][1], modelView[0][2])),
+                                vsg::length(vsg::dvec3(modelView[1][0], modelView[1][1], modelView[1][2])),
+                                vsg::length(vsg::dvec3(modelView[2][0], modelView[2][1], modelView[2][2]))});
+
+        _frames.push_back(frame);
+    }
+
+    bool visible(const vsg::dsphere &bound) const
+    {
+        if (!_cull || !bound.valid())
+            return true;
+
+        for (auto &plane : _frames.back().planes)
+        {
+            if (plane.x * bound.center.x + plane.y * bound.center.y + plane.z * bound.center.z + plane.w < -bound.radius)
+                return false;
+        }
+
+        return true;
+    }
+
+    double screenHeightRatio(const vsg::dsphere &bound) const
+    {
+        const auto &frame = _frames.back();
+        const auto radius = bound.radius * frame.scale * std::abs(_projection[1][1]);
+
+        // orthographic projections do not shrink with distance
+        if (_projection[3][3] == 1.0)
+            return radius;
+
+        const auto eye = frame.modelView * vsg::dvec4(bound.center.x, bound.center.y, bound.center.z, 1.0);
+        const auto distance = -eye.z;
+        return distance > 0.0 ? radius / distance : std::numeric_limits<double>::max();
+    }
+
+    void push(vsg::StateCommand *stateCommand)
+    {
+        if (_slots.size() <= stateCommand->slot)
+            _slots.resize(stateCommand->slot + 1);
+
+        auto &slot = _slots[stateCommand->slot];
+        slot.stack.push_back(stateCommand);
+        slot.dirty = true;
+    }
+
+    void pop(vsg::StateCommand *stateCommand)
+    {
+        auto &slot = _slots[stateCommand->slot];
+        slot.stack.pop_back();
+        slot.dirty = !slot.stack.empty();
+    }
+
+    // what vsg's State records before a draw
+    void recordState()
+    {
+        for (auto &slot : _slots)
+        {
+            if (!slot.dirty)
+                continue;
+
+            auto top = slot.stack.back();
+            if (auto bind = top->cast<vsg::BindGraphicsPipeline>())
+            {
+                ++counters.pipelineBinds;
+                _topology = topologyOf(bind);
+            }
+            else if (top->cast<vsg::BindDescriptorSet>() || top->cast<vsg::BindDescriptorSets>())
+            {
+                ++counters.descriptorBinds;
+            }
+
+            slot.dirty = false;
+        }
+    }
+
+    vsg::dmat4 _projection;
+    bool _cull{false};
+    std::vector<Frame> _frames;
+    std::vector<Slot> _slots;
+    VkPrimitiveTopology _topology{VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST};
+};
+
+}
+
+using namespace vsgQt;
+
+SceneStats::Counters &SceneStats::Counters::operator+=(const Counters &other)
+{
+    drawCalls += other.drawCalls;
+    indexedPrimitives += other.indexedPrimitives;
+    pipelineBinds += other.pipelineBinds;
+    descriptorBinds += other.descriptorBinds;
+    culledNodes += other.culledNodes;
+    return *this;
+}
+
+SceneStats::Counters SceneStats::collect(vsg::Node *scene, const vsg::dmat4 &projection, const vsg::dmat4 &view)
+{
+    CollectCounters collector(projection, view);
+    scene->accept(collector);
+    return collector.counters;
+}
+
+SceneStats::Counters SceneStats::collect(vsg::Node *scene)
+{
+    CollectCounters collector;
+    scene->accept(collector);
+    return collector.counters;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <vsg/maths/mat4.h>
+#include <vsg/nodes/Node.h>
+
+#include <cstdint>
+
+namespace vsgQt {
+
+// Counts what recording a view of a scene submits: draw calls, primitives of
+// indexed draws, pipeline and descriptor set binds and the nodes frustum
+// culling skips. The record traversal keeps no counters, so this follows its
+// culling, level of detail and Switch selection and lazy state binding in a
+// traversal of its own, which costs nothing unless it is run.
+class SceneStats
+{
+public:
+
+    struct Counters
+    {
+        uint64_t drawCalls{0};
+        uint64_t indexedPrimitives{0};
+        uint64_t pipelineBinds{0};
+        uint64_t descriptorBinds{0};
+        uint64_t culledNodes{0};
+
+        Counters &operator+=(const Counters &other);
+    };
+
+    static Counters collect(vsg::Node *scene, const vsg::dmat4 &projection, const vsg::dmat4 &view);
+
+    // the same without a camera, nothing is culled and every level of detail
+    // is counted, as if each was recorded once
+    static Counters collect(vsg::Node *scene);
+};
+
+}
@@ -0,0 +1,212 @@
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+
+#include "ShaderCache.h"
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QLoggingCategory>
+#include <QSaveFile>
+
+#include <vsg/all.h>
+
+#include <algorithm>
+#include <cstring>
+#include <future>
+#include <set>
+#include <string>
+
+namespace {
+static QLoggingCategory lc("shadercache");
+
+// bump when the stored SPIR-V is no longer compatible, e.g. other compile options
+constexpr char CacheVersion[] = "vsgQt-spirv-2";
+
+class CollectShaderStages : public vsg::Visitor
+{
+public:
+
+    void apply(vsg::Object &object) override
+    {
+        object.traverse(*this);
+    }
+
+    void apply(vsg::StateGroup &stateGroup) override
+    {
+        for (auto &command : stateGroup.getStateCommands())
+            command->accept(*this);
+
+        stateGroup.traverse(*this);
+    }
+
+    void apply(vsg::BindGraphicsPipeline &bindPipeline) override
+    {
+        if (!bindPipeline.pipeline)
+            return;
+
+        for (auto &stage : bindPipeline.pipeline->stages)
+        {
+            // modules shared by several pipelines are handled once
+            if (stage && stage->module && stage->module->code.empty() && !stage->module->source.empty() && modules.insert(stage->module.get()).second)
+                stages.push_back(stage);
+        }
+    }
+
+    std::set<vsg::ShaderModule *> modules;
+    std::vector<vsg::ref_ptr<vsg::ShaderStage>> stages;
+};
+}
+
+using namespace vsgQt;
+
+void ShaderCache::setDirectory(const QString &directory)
+{
+    std::scoped_lock lock(_mutex);
+
+    _directory = directory;
+    if (!_directory.isEmpty())
+        QDir().mkpath(_directory);
+}
+
+QByteArray ShaderCache::key(const vsg::ShaderStage &stage)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+
+    const auto flags = static_cast<uint32_t>(stage.stage);
+    hash.addData(CacheVersion, sizeof(CacheVersion));
+    hash.addData(reinterpret_cast<const char *>(&flags), sizeof(flags));
+    hash.addData(stage.entryPointName.data(), static_cast<int>(stage.entryPointName.size()) + 1);
+    hash.addData(stage.module->source.data(), static_cast<int>(stage.module->source.size()));
+
+    // the defines and compile settings change the SPIR-V of the same source
+    if (auto &hints = stage.module->hints)
+    {
+        const int32_t settings[] = {
+            static_cast<int32_t>(hints->vulkanVersion),
+            static_cast<int32_t>(hints->clientInputVersion),
+            static_cast<int32_t>(hints->language),
+            static_cast<int32_t>(hints->target),
+            hints->forwardCompatible ? 1 : 0,
+            hints->generateDebugInfo ? 1 : 0
+        };
+        hash.addData(reinterpret_cast<const char *>(settings), sizeof(settings));
+        hash.addData(hints->defaultVersion.data(), static_cast<int>(hints->defaultVersion.size()) + 1);
+
+        std::vector<std::string> defines(hints->defines.begin(), hints->defines.end());
+        std::sort(defines.begin(), defines.end());
+        for (auto &define : defines)
+            hash.addData(define.data(), static_cast<int>(define.size()) + 1);
+    }
+
+    return hash.result().toHex();
+}
+
+bool ShaderCache::prepare(vsg::Node *node, Stats *stats)
+{
+    CollectShaderStages collect;
+    node->accept(collect);
+
+    Stats local;
+
+    // stages with the same key are compiled once
+    std::map<QByteArray, std::vector<vsg::ref_ptr<vsg::ShaderStage>>> misses;
+    for (auto &stage : collect.stages)
+    {
+        auto stageKey = key(*stage);
+        if (!find(stageKey, stage->module->code, local))
+            misses[stageKey].push_back(stage);
+    }
+
+    std::vector<std::pair<QByteArray, std::future<bool>>> compiles;
+    for (auto &[missKey, stages] : misses)
+    {
+        compiles.emplace_back(missKey, std::async(std::launch::async, [stage = stages.front()]() {
+            vsg::ShaderCompiler compiler;
+            vsg::ShaderStages shaders{stage};
+            return compiler.compile(shaders);
+        }));
+    }
+
+    bool success = true;
+    for (auto &[missKey, result] : compiles)
+    {
+        auto &stages = misses[missKey];
+        const auto &code = stages.front()->module->code;
+
+        if (!result.get() || code.empty())
+        {
+            qCWarning(lc) << "Failed to compile shader" << missKey;
+            ++local.failed;
+            success = false;
+            continue;
+        }
+
+        ++local.compiled;
+        store(missKey, code);
+
+        for (size_t i = 1; i < stages.size(); ++i)
+            stages[i]->module->code = code;
+    }
+
+    if (stats)
+        *stats = local;
+
+    return success;
+}
+
+bool ShaderCache::find(const QByteArray &key, std::vector<uint32_t> &code, Stats &stats)
+{
+    std::scoped_lock lock(_mutex);
+
+    if (auto itr = _memory.find(key); itr != _memory.end())
+    {
+        code = itr->second;
+        ++stats.memoryHits;
+        return true;
+    }
+
+    if (_directory.isEmpty())
+        return false;
+
+    QFile file(QDir(_directory).filePath(QString::fromLatin1(key) + ".spv"));
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    const auto data = file.readAll();
+    if (data.isEmpty() || data.size() % sizeof(uint32_t) != 0)
+        return false;
+
+    code.resize(static_cast<size_t>(data.size()) / sizeof(uint32_t));
+    std::memcpy(code.data(), data.constData(), static_cast<size_t>(data.size()));
+
+    // a SPIR-V module starts with its magic number, anything else is not ours
+    if (code.front() != 0x07230203)
+    {
+        code.clear();
+        return false;
+    }
+
+    _memory[key] = code;
+    ++stats.diskHits;
+    return true;
+}
+
+void ShaderCache::store(const QByteArray &key, const std::vector<uint32_t> &code)
+{
+    std::scoped_lock lock(_mutex);
+
+    _memory[key] = code;
+
+    if (_directory.isEmpty())
+        return;
+
+    QSaveFile file(QDir(_directory).filePath(QString::fromLatin1(key) + ".spv"));
+    if (file.open(QIODevice::WriteOnly))
+    {
+        file.write(reinterpret_cast<const char *>(code.data()), static_cast<qint64>(code.size() * sizeof(uint32_t)));
+        if (!file.commit())
+            qCWarning(lc) << "Could not write" << file.fileName();
+    }
+}
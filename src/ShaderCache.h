@@ -0,0 +1,55 @@
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+
+#include <vsg/core/ref_ptr.h>
+#include <vsg/nodes/Node.h>
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace vsg {
+class ShaderStage;
+}
+
+namespace vsgQt {
+
+// Content addressed cache of the SPIR-V of shaders that are loaded as GLSL
+// source. Shaders are keyed by a hash of stage, entry point, source, defines
+// and compile settings, so edited shaders simply get a new entry. Hits are served from memory or from
+// one file per shader, only misses go through glslang, distinct ones in
+// parallel.
+class ShaderCache
+{
+public:
+
+    struct Stats
+    {
+        uint32_t memoryHits{0};
+        uint32_t diskHits{0};
+        uint32_t compiled{0};
+        uint32_t failed{0};
+    };
+
+    void setDirectory(const QString &directory);
+
+    // fills in the SPIR-V of every shader under node that only has source,
+    // returns false if one of them failed to compile
+    bool prepare(vsg::Node *node, Stats *stats = nullptr);
+
+    static QByteArray key(const vsg::ShaderStage &stage);
+
+protected:
+
+    bool find(const QByteArray &key, std::vector<uint32_t> &code, Stats &stats);
+    void store(const QByteArray &key, const std::vector<uint32_t> &code);
+
+    mutable std::mutex _mutex;
+    QString _directory;
+    std::map<QByteArray, std::vector<uint32_t>> _memory;
+};
+
+}
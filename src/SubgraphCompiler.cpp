@@ -0,0 +1,98 @@
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+
+#include "SubgraphCompiler.h"
+
+#include <vsg/all.h>
+
+using namespace vsgQt;
+
+void SubgraphCompiler::setup(vsg::ref_ptr<vsg::Window> window, vsg::ref_ptr<vsg::ViewportState> viewport)
+{
+    std::scoped_lock lock(_mutex);
+
+    _window = window;
+    _viewport = viewport;
+    _available.clear();
+}
+
+void SubgraphCompiler::release()
+{
+    std::scoped_lock lock(_mutex);
+
+    _available.clear();
+    _viewport = {};
+    _window = {};
+}
+
+bool SubgraphCompiler::valid() const
+{
+    std::scoped_lock lock(_mutex);
+    return _window.valid();
+}
+
+bool SubgraphCompiler::compile(vsg::Node *node, Stats *stats)
+{
+    auto compileTraversal = takeCompileTraversal();
+    if (!compileTraversal)
+        return false;
+
+    const auto start = std::chrono::steady_clock::now();
+
+    // size the descriptor pool for the new subgraph only
+    vsg::CollectDescriptorStats collectStats;
+    node->accept(collectStats);
+
+    const auto maxSets = collectStats.computeNumDescriptorSets();
+    const auto descriptorPoolSizes = collectStats.computeDescriptorPoolSizes();
+
+    compileTraversal->context.descriptorPool = {};
+    if (maxSets > 0 && !descriptorPoolSizes.empty())
+        compileTraversal->context.descriptorPool = vsg::DescriptorPool::create(compileTraversal->context.device, maxSets, descriptorPoolSizes);
+
+    node->accept(*compileTraversal);
+    compileTraversal->context.record();
+    compileTraversal->context.waitForCompletion();
+
+    // the descriptor sets keep their pool alive, the traversal must not
+    compileTraversal->context.descriptorPool = {};
+
+    returnCompileTraversal(compileTraversal);
+
+    if (stats)
+    {
+        std::scoped_lock lock(_mutex);
+        stats->modelIndex = ++_numCompiled;
+        stats->numDescriptorSets = maxSets;
+        stats->duration = std::chrono::steady_clock::now() - start;
+    }
+
+    return true;
+}
+
+vsg::ref_ptr<vsg::CompileTraversal> SubgraphCompiler::takeCompileTraversal()
+{
+    std::scoped_lock lock(_mutex);
+
+    if (!_window)
+        return {};
+
+    if (!_available.empty())
+    {
+        auto compileTraversal = _available.back();
+        _available.pop_back();
+        return compileTraversal;
+    }
+
+    return vsg::CompileTraversal::create(_window, _viewport);
+}
+
+void SubgraphCompiler::returnCompileTraversal(vsg::ref_ptr<vsg::CompileTraversal> compileTraversal)
+{
+    std::scoped_lock lock(_mutex);
+
+    // drop traversals created for a window that has been released meanwhile
+    if (_window)
+        _available.push_back(compileTraversal);
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <vsg/core/ref_ptr.h>
+#include <vsg/nodes/Node.h>
+#include <vsg/traversals/CompileTraversal.h>
+#include <vsg/viewer/Window.h>
+
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+namespace vsgQt {
+
+// Compiles a single subgraph against the device of an already compiled viewer.
+// Compile traversals (and with them their command pools) are reused between
+// calls, descriptor pools are sized for the subgraph alone. The cost of a call
+// therefore only depends on the size of the subgraph, not on the scene it is
+// added to.
+class SubgraphCompiler
+{
+public:
+
+    struct Stats
+    {
+        uint32_t modelIndex{0};
+        uint32_t numDescriptorSets{0};
+        std::chrono::duration<double, std::milli> duration{0.0};
+    };
+
+    void setup(vsg::ref_ptr<vsg::Window> window, vsg::ref_ptr<vsg::ViewportState> viewport);
+    void release();
+
+    bool valid() const;
+    bool compile(vsg::Node *node, Stats *stats = nullptr);
+
+protected:
+
+    vsg::ref_ptr<vsg::CompileTraversal> takeCompileTraversal();
+    void returnCompileTraversal(vsg::ref_ptr<vsg::CompileTraversal> compileTraversal);
+
+    mutable std::mutex _mutex;
+    vsg::ref_ptr<vsg::Window> _window;
+    vsg::ref_ptr<vsg::ViewportState> _viewport;
+    std::vector<vsg::ref_ptr<vsg::CompileTraversal>> _available;
+    uint32_t _numCompiled{0};
+};
+
+}
@@ -0,0 +1,445 @@
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+
+#include "TextureCompressor.h"
+#include "FunctionRunnable.h"
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QLoggingCategory>
+#include <QSaveFile>
+
+#include <vsg/all.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <future>
+#include <limits>
+#include <map>
+#include <memory>
+
+namespace {
+static QLoggingCategory lc("texturecompressor");
+
+constexpr quint32 CacheMagic = 0x43425156; // "VQBC"
+constexpr quint32 CacheVersion = 1;
+
+// the images of all descriptors, grouped by the data they are created from
+class CollectImages : public vsg::Visitor
+{
+public:
+
+    void apply(vsg::Object &object) override
+    {
+        object.traverse(*this);
+    }
+
+    void apply(vsg::StateGroup &stateGroup) override
+    {
+        for (auto &command : stateGroup.getStateCommands())
+            command->accept(*this);
+
+        stateGroup.traverse(*this);
+    }
+
+    void apply(vsg::DescriptorImage &descriptorImage) override
+    {
+        for (auto &imageInfo : descriptorImage.imageInfoList)
+        {
+            if (imageInfo && imageInfo->imageView && imageInfo->imageView->image && imageInfo->imageView->image->data)
+                images[imageInfo->imageView->image->data.get()].push_back(imageInfo->imageView->image);
+        }
+    }
+
+    std::map<const vsg::Data *, std::vector<vsg::ref_ptr<vsg::Image>>> images;
+};
+
+uint16_t pack565(const int color[3])
+{
+    return static_cast<uint16_t>(((color[0] * 31 + 127) / 255) << 11 | ((color[1] * 63 + 127) / 255) << 5 | ((color[2] * 31 + 127) / 255));
+}
+
+void unpack565(uint16_t packed, int color[3])
+{
+    const int r = (packed >> 11) & 31;
+    const int g = (packed >> 5) & 63;
+    const int b = packed & 31;
+    color[0] = (r << 3) | (r >> 2);
+    color[1] = (g << 2) | (g >> 4);
+    color[2] = (b << 3) | (b >> 2);
+}
+
+// 4 color block, endpoints from the bounding box inset by 1/16 of its size
+void encodeColor(const vsg::ubvec4 texels[16], uint8_t *block)
+{
+    int low[3] = {255, 255, 255};
+    int high[3] = {0, 0, 0};
+    for (int i = 0; i < 16; ++i)
+    {
+        for (int c = 0; c < 3; ++c)
+        {
+            low[c] = std::min(low[c], static_cast<int>(texels[i][c]));
+            high[c] = std::max(high[c], static_cast<int>(texels[i][c]));
+        }
+    }
+
+    for (int c = 0; c < 3; ++c)
+    {
+        const int inset = (high[c] - low[c]) >> 4;
+        low[c] += inset;
+        high[c] -= inset;
+    }
+
+    const uint16_t color0 = pack565(high);
+    const uint16_t color1 = pack565(low);
+
+    uint32_t indices = 0;
+    if (color0 != color1)
+    {
+        int palette[4][3];
+        unpack565(color0, palette[0]);
+        unpack565(color1, palette[1]);
+        for (int c = 0; c < 3; ++c)
+        {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+
+        for (int i = 0; i < 16; ++i)
+        {
+            uint32_t best = 0;
+            int bestDistance = std::numeric_limits<int>::max();
+            for (uint32_t p = 0; p < 4; ++p)
+            {
+                int distance = 0;
+                for (int c = 0; c < 3; ++c)
+                {
+                    const int d = static_cast<int>(texels[i][c]) - palette[p][c];
+                    distance += d * d;
+                }
+
+                if (distance < bestDistance)
+                {
+                    bestDistance = distance;
+                    best = p;
+                }
+            }
+            indices |= best << (2 * i);
+        }
+    }
+
+    // with color0 > color1 the block is in 4 color mode, equal endpoints only use index 0
+    block[0] = static_cast<uint8_t>(color0);
+    block[1] = static_cast<uint8_t>(color0 >> 8);
+    block[2] = static_cast<uint8_t>(color1);
+    block[3] = static_cast<uint8_t>(color1 >> 8);
+    for (int i = 0; i < 4; ++i)
+        block[4 + i] = static_cast<uint8_t>(indices >> (8 * i));
+}
+
+// 8 alpha block between the lowest and highest alpha
+void encodeAlpha(const vsg::ubvec4 texels[16], uint8_t *block)
+{
+    int alpha0 = 0;
+    int alpha1 = 255;
+    for (int i = 0; i < 16; ++i)
+    {
+        alpha0 = std::max(alpha0, static_cast<int>(texels[i].a));
+        alpha1 = std::min(alpha1, static_cast<int>(texels[i].a));
+    }
+
+    uint64_t indices = 0;
+    if (alpha0 > alpha1)
+    {
+        int palette[8] = {alpha0, alpha1};
+        for (int p = 2; p < 8; ++p)
+            palette[p] = ((8 - p) * alpha0 + (p - 1) * alpha1) / 7;
+
+        for (int i = 0; i < 16; ++i)
+        {
+            uint64_t best = 0;
+            int bestDistance = 256;
+            for (uint64_t p = 0; p < 8; ++p)
+            {
+                const int distance = std::abs(static_cast<int>(texels[i].a) - palette[p]);
+                if (distance < bestDistance)
+                {
+                    bestDistance = distance;
+                    best = p;
+                }
+            }
+            indices |= best << (3 * i);
+        }
+    }
+
+    block[0] = static_cast<uint8_t>(alpha0);
+    block[1] = static_cast<uint8_t>(alpha1);
+    for (int i = 0; i < 6; ++i)
+        block[2 + i] = static_cast<uint8_t>(indices >> (8 * i));
+}
+
+// box filtered next level, the dimensions are even
+std::vector<vsg::ubvec4> downsample(const std::vector<vsg::ubvec4> &texels, uint32_t width, uint32_t height)
+{
+    const uint32_t halfWidth = width / 2;
+    const uint32_t halfHeight = height / 2;
+
+    std::vector<vsg::ubvec4> result(static_cast<size_t>(halfWidth) * halfHeight);
+    for (uint32_t y = 0; y < halfHeight; ++y)
+    {
+        for (uint32_t x = 0; x < halfWidth; ++x)
+        {
+            const auto *row0 = &texels[static_cast<size_t>(y * 2) * width + x * 2];
+            const auto *row1 = row0 + width;
+
+            auto &texel = result[static_cast<size_t>(y) * halfWidth + x];
+            for (int c = 0; c < 4; ++c)
+                texel[c] = static_cast<uint8_t>((row0[0][c] + row0[1][c] + row1[0][c] + row1[1][c] + 2) / 4);
+        }
+    }
+    return result;
+}
+
+uint32_t blockSize(VkFormat format)
+{
+    return (format == VK_FORMAT_BC3_UNORM_BLOCK || format == VK_FORMAT_BC3_SRGB_BLOCK) ? 16 : 8;
+}
+
+size_t countBlocks(uint32_t blocksWide, uint32_t blocksHigh, uint32_t levels)
+{
+    size_t numBlocks = 0;
+    for (uint32_t level = 0; level < levels; ++level)
+        numBlocks += static_cast<size_t>(blocksWide >> level) * (blocksHigh >> level);
+    return numBlocks;
+}
+
+vsg::ref_ptr<vsg::Data> createBlocks(VkFormat format, uint32_t blocksWide, uint32_t blocksHigh, uint32_t levels, uint8_t origin, size_t numBlocks)
+{
+    vsg::Data::Layout layout;
+    layout.format = format;
+    layout.stride = blockSize(format);
+    layout.maxNumMipmaps = static_cast<uint8_t>(levels);
+    layout.blockWidth = 4;
+    layout.blockHeight = 4;
+    layout.origin = origin;
+
+    if (blockSize(format) == 16)
+        return vsg::block128Array2D::create(blocksWide, blocksHigh, new vsg::block128[numBlocks], layout);
+    return vsg::block64Array2D::create(blocksWide, blocksHigh, new vsg::block64[numBlocks], layout);
+}
+
+}
+
+using namespace vsgQt;
+
+void TextureCompressor::setCacheDirectory(const QString &directory)
+{
+    _cacheDirectory = directory;
+    if (!_cacheDirectory.isEmpty())
+        QDir().mkpath(_cacheDirectory);
+}
+
+bool TextureCompressor::isSupported(VkInstance instance)
+{
+    uint32_t count = 0;
+    vkEnumeratePhysicalDevices(instance, &count, nullptr);
+    std::vector<VkPhysicalDevice> physicalDevices(count);
+    vkEnumeratePhysicalDevices(instance, &count, physicalDevices.data());
+
+    // the device is picked later, so every candidate has to support it
+    return !physicalDevices.empty() && std::all_of(physicalDevices.begin(), physicalDevices.end(), [](VkPhysicalDevice physicalDevice) {
+        VkPhysicalDeviceFeatures features;
+        vkGetPhysicalDeviceFeatures(physicalDevice, &features);
+        return features.textureCompressionBC == VK_TRUE;
+    });
+}
+
+vsg::ref_ptr<vsg::Data> TextureCompressor::compress(const vsg::Data *image)
+{
+    auto source = dynamic_cast<const vsg::ubvec4Array2D *>(image);
+    if (!source)
+        return {};
+
+    const auto &sourceLayout = source->getLayout();
+    const bool srgb = sourceLayout.format == VK_FORMAT_R8G8B8A8_SRGB;
+    if ((sourceLayout.format != VK_FORMAT_R8G8B8A8_UNORM && !srgb) || sourceLayout.maxNumMipmaps > 1)
+        return {};
+
+    const uint32_t width = source->width();
+    const uint32_t height = source->height();
+    if (width == 0 || height == 0 || width % 4 != 0 || height % 4 != 0)
+        return {};
+
+    const uint32_t blocksWide = width / 4;
+    const uint32_t blocksHigh = height / 4;
+
+    // levels stay whole numbers of blocks, as vsg halves the block dimensions per level
+    uint32_t levels = 1;
+    while ((blocksWide >> levels) > 0 && (blocksHigh >> levels) > 0 && ((blocksWide >> levels) << levels) == blocksWide && ((blocksHigh >> levels) << levels) == blocksHigh)
+        ++levels;
+
+    const bool transparent = std::any_of(source->begin(), source->end(), [](const vsg::ubvec4 &texel) { return texel.a < 255; });
+    const VkFormat format = transparent ? (srgb ? VK_FORMAT_BC3_SRGB_BLOCK : VK_FORMAT_BC3_UNORM_BLOCK) : (srgb ? VK_FORMAT_BC1_RGB_SRGB_BLOCK : VK_FORMAT_BC1_RGB_UNORM_BLOCK);
+
+    const auto numBlocks = countBlocks(blocksWide, blocksHigh, levels);
+    auto compressed = createBlocks(format, blocksWide, blocksHigh, levels, sourceLayout.origin, numBlocks);
+    auto out = static_cast<uint8_t *>(compressed->dataPointer());
+
+    std::vector<vsg::ubvec4> texels(source->begin(), source->end());
+    uint32_t levelWidth = width;
+    uint32_t levelHeight = height;
+
+    for (uint32_t level = 0; level < levels; ++level)
+    {
+        if (level > 0)
+        {
+            texels = downsample(texels, levelWidth, levelHeight);
+            levelWidth /= 2;
+            levelHeight /= 2;
+        }
+
+        for (uint32_t by = 0; by < levelHeight / 4; ++by)
+        {
+            for (uint32_t bx = 0; bx < levelWidth / 4; ++bx)
+            {
+                vsg::ubvec4 block[16];
+                for (uint32_t y = 0; y < 4; ++y)
+                {
+                    for (uint32_t x = 0; x < 4; ++x)
+                        block[y * 4 + x] = texels[static_cast<size_t>(by * 4 + y) * levelWidth + bx * 4 + x];
+                }
+
+                if (transparent)
+                {
+                    encodeAlpha(block, out);
+                    encodeColor(block, out + 8);
+                    out += 16;
+                }
+                else
+                {
+                    encodeColor(block, out);
+                    out += 8;
+                }
+            }
+        }
+    }
+
+    return compressed;
+}
+
+QString TextureCompressor::cacheFilename(const vsg::Data *image) const
+{
+    if (_cacheDirectory.isEmpty())
+        return {};
+
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    const quint32 header[] = {CacheVersion, image->width(), image->height(), static_cast<quint32>(image->getLayout().format)};
+    hash.addData(reinterpret_cast<const char *>(header), sizeof(header));
+    hash.addData(static_cast<const char *>(image->dataPointer()), static_cast<int>(image->dataSize()));
+
+    return QDir(_cacheDirectory).filePath(QString::fromLatin1(hash.result().toHex()) + ".bc");
+}
+
+vsg::ref_ptr<vsg::Data> TextureCompressor::load(const QString &filename) const
+{
+    QFile file(filename);
+    if (filename.isEmpty() || !file.open(QIODevice::ReadOnly))
+        return {};
+
+    QDataStream in(&file);
+    quint32 magic = 0, version = 0, format = 0, blocksWide = 0, blocksHigh = 0, levels = 0, origin = 0;
+    in >> magic >> version >> format >> blocksWide >> blocksHigh >> levels >> origin;
+    if (in.status() != QDataStream::Ok || magic != CacheMagic || version != CacheVersion || levels == 0 || levels > 16)
+        return {};
+
+    const auto numBlocks = countBlocks(blocksWide, blocksHigh, levels);
+    const auto size = numBlocks * blockSize(static_cast<VkFormat>(format));
+    if (numBlocks == 0 || file.size() - file.pos() != static_cast<qint64>(size))
+        return {};
+
+    auto compressed = createBlocks(static_cast<VkFormat>(format), blocksWide, blocksHigh, levels, static_cast<uint8_t>(origin), numBlocks);
+    if (in.readRawData(static_cast<char *>(compressed->dataPointer()), static_cast<int>(size)) != static_cast<int>(size))
+        return {};
+
+    return compressed;
+}
+
+void TextureCompressor::store(const QString &filename, const vsg::Data *compressed) const
+{
+    if (filename.isEmpty())
+        return;
+
+    QSaveFile file(filename);
+    if (!file.open(QIODevice::WriteOnly))
+        return;
+
+    const auto &layout = compressed->getLayout();
+
+    const auto numBlocks = countBlocks(compressed->width(), compressed->height(), layout.maxNumMipmaps);
+
+    QDataStream out(&file);
+    out << CacheMagic << CacheVersion << static_cast<quint32>(layout.format) << compressed->width() << compressed->height()
+        << static_cast<quint32>(layout.maxNumMipmaps) << static_cast<quint32>(layout.origin);
+    out.writeRawData(static_cast<const char *>(compressed->dataPointer()), static_cast<int>(numBlocks * blockSize(layout.format)));
+
+    if (!file.commit())
+        qCWarning(lc) << "Could not write" << filename;
+}
+
+TextureCompressor::Report TextureCompressor::apply(vsg::Node *node) const
+{
+    CollectImages collect;
+    node->accept(collect);
+
+    Report report;
+
+    struct Job
+    {
+        const vsg::Data *source;
+        QString cached;
+        std::future<vsg::ref_ptr<vsg::Data>> result;
+    };
+
+    std::vector<Job> jobs;
+    for (auto &[source, images] : collect.images)
+    {
+        const auto cached = cacheFilename(source);
+        auto promise = std::make_shared<std::promise<vsg::ref_ptr<vsg::Data>>>();
+        jobs.push_back({source, cached, promise->get_future()});
+
+        _pool.start(new FunctionRunnable([this, source = source, cached, promise]() {
+            auto compressed = load(cached);
+            promise->set_value(compressed ? compressed : compress(source));
+        }));
+    }
+
+    for (auto &job : jobs)
+    {
+        auto compressed = job.result.get();
+        if (!compressed)
+            continue;
+
+        if (!QFileInfo::exists(job.cached))
+            store(job.cached, compressed);
+        else
+            ++report.cached;
+
+        const auto &layout = compressed->getLayout();
+        for (auto &image : collect.images[job.source])
+        {
+            image->data = compressed;
+            image->format = layout.format;
+            image->mipLevels = layout.maxNumMipmaps;
+        }
+
+        ++report.textures;
+        report.sourceBytes += job.source->dataSize();
+        report.compressedBytes += countBlocks(compressed->width(), compressed->height(), layout.maxNumMipmaps) * blockSize(layout.format);
+    }
+
+    return report;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <QString>
+#include <QThreadPool>
+
+#include <vsg/core/Data.h>
+#include <vsg/core/ref_ptr.h>
+#include <vsg/nodes/Node.h>
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+
+namespace vsgQt {
+
+// Transcodes the RGBA8 textures of a model to BC1, or BC3 when they have
+// transparent texels, with a generated mip chain. Textures are compressed in
+// parallel, on a pool of as many threads as there are cores shared by all
+// models, and the results are kept in the cache directory, keyed by the
+// content of the source image.
+//
+// Textures need a width and height that are multiples of 4, the mip chain
+// stops at the first level that does not divide into whole blocks.
+class TextureCompressor
+{
+public:
+
+    struct Report
+    {
+        uint32_t textures{0};
+        uint32_t cached{0};
+        uint64_t sourceBytes{0};
+        uint64_t compressedBytes{0};
+    };
+
+    // no cache when empty
+    void setCacheDirectory(const QString &directory);
+
+    Report apply(vsg::Node *node) const;
+
+    // the compressed image with its mip chain, none if image is not supported
+    static vsg::ref_ptr<vsg::Data> compress(const vsg::Data *image);
+
+    // textureCompressionBC of every physical device of instance
+    static bool isSupported(VkInstance instance);
+
+private:
+
+    QString cacheFilename(const vsg::Data *image) const;
+    vsg::ref_ptr<vsg::Data> load(const QString &filename) const;
+    void store(const QString &filename, const vsg::Data *compressed) const;
+
+    QString _cacheDirectory;
+    mutable QThreadPool _pool;
+};
+
+}
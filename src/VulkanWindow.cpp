@@ -3,6 +3,26 @@
 #endif
 
 #include "VulkanWindow.h"
+#include "AutoInstancer.h"
+#include "BinaryCache.h"
+#include "EventPool.h"
+#include "EventQueue.h"
+#include "FrameCapture.h"
+#include "FrameProfiler.h"
+#include "LodGenerator.h"
+#include "MemoryBudget.h"
+#include "ModelLoader.h"
+#include "PagingBudget.h"
+#include "Picker.h"
+#include "ParallelRenderGraph.h"
+#include "PipelineCache.h"
+#include "SceneBounds.h"
+#include "SceneOptimizer.h"
+#include "SceneSetup.h"
+#include "SceneStats.h"
+#include "ShaderCache.h"
+#include "SubgraphCompiler.h"
+#include "TextureCompressor.h"
 
 #include <vulkan/vulkan.h>
 
@@ -17,11 +37,22 @@
 #include <QPlatformSurfaceEvent>
 #include <QThread>
 #include <QCoreApplication>
+#include <QDir>
 #include <QLoggingCategory>
+#include <QStandardPaths>
+#include <QPointer>
+#include <QTimer>
 
 #include <vsg/all.h>
 #include <vsg/viewer/Window.h>
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
 
 namespace {
 static QLoggingCategory lc("vulkanwindow");
@@ -29,6 +60,16 @@ static QLoggingCategory lc("vulkanwindow");
 
 namespace vsgQt {
 
+static VkPresentModeKHR toVkPresentMode(VulkanWindow::PresentMode mode)
+{
+    switch (mode)
+    {
+    case VulkanWindow::PresentMode::Mailbox: return VK_PRESENT_MODE_MAILBOX_KHR;
+    case VulkanWindow::PresentMode::Immediate: return VK_PRESENT_MODE_IMMEDIATE_KHR;
+    default: return VK_PRESENT_MODE_FIFO_KHR;
+    }
+}
+
 static vsg::ref_ptr<vsg::Data> createWhiteTexture()
 {
     auto vsg_data = vsg::vec4Array2D::create(1,1, vsg::Data::Layout{VK_FORMAT_R32G32B32A32_SFLOAT});
@@ -69,6 +110,10 @@ public:
 
         _extent2D.width = win->size().width();
         _extent2D.height = win->size().height();
+        setNativeExtent(win->size().width(), win->size().height());
+        commitExtent();
+        _appliedWidth = _width;
+        _appliedHeight = _height;
 
         traits->nativeWindow = win;
     }
@@ -82,120 +127,1103 @@ public:
 
     bool pollEvents(vsg::UIEvents &events) override
     {
-        if (bufferedEvents.size() > 0)
+        // Consecutive pointer moves collapse into the latest one and consecutive
+        // wheel events into one with the summed delta, so the handlers see a
+        // bounded number of events per frame. Other events keep their order.
+        vsg::UIEvent *last = nullptr;
+
+        if (const auto coalesced = bufferedEvents.coalesced(); coalesced != _reportedCoalesced)
         {
-            events.splice(events.end(), bufferedEvents);
-            bufferedEvents.clear();
-            return true;
+            qCDebug(lc) << "Input queue was full," << coalesced - _reportedCoalesced << "pointer moves coalesced";
+            _reportedCoalesced = coalesced;
         }
 
-        return false;
+        return bufferedEvents.consume([&](vsg::ref_ptr<vsg::UIEvent> event) {
+            if (event->cast<vsg::KeyEvent>() || event->cast<vsg::PointerEvent>() || event->cast<vsg::ScrollWheelEvent>())
+            {
+                if (!_hasInput || event->time < _inputTime)
+                    _inputTime = event->time;
+                _hasInput = true;
+            }
+
+            if (last)
+            {
+                auto lastMove = last->cast<vsg::MoveEvent>();
+                auto move = event->cast<vsg::MoveEvent>();
+                if (lastMove && move && lastMove->mask == move->mask)
+                {
+                    events.back() = event;
+                    last = event.get();
+                    return;
+                }
+
+                auto lastScroll = last->cast<vsg::ScrollWheelEvent>();
+                auto scroll = event->cast<vsg::ScrollWheelEvent>();
+                if (lastScroll && scroll)
+                {
+                    lastScroll->delta += scroll->delta;
+                    lastScroll->time = scroll->time;
+                    return;
+                }
+            }
+
+            last = event.get();
+            events.emplace_back(std::move(event));
+        });
+    }
+
+    // Called from the GUI thread, the frame loop may run on another thread.
+    // setNativeExtent() tracks every size Qt reports, the swapchain only
+    // follows once commitExtent() is called, i.e. when a resize has settled.
+    void setNativeExtent(int width, int height)
+    {
+        _nativeWidth = width;
+        _nativeHeight = height;
+    }
+
+    void commitExtent()
+    {
+        _width = _nativeWidth.load();
+        _height = _nativeHeight.load();
+    }
+
+    // time of the earliest input event polled since the last call
+    bool takeInputTime(vsg::clock::time_point &time)
+    {
+        if (!_hasInput)
+            return false;
+
+        time = _inputTime;
+        _hasInput = false;
+        return true;
+    }
+
+    // present mode and image count are taken from the traits' swapchain
+    // preferences when the swapchain is built
+    void setSwapchainPreferences(VkPresentModeKHR presentMode, uint32_t imageCount)
+    {
+        _traits->swapchainPreferences.presentMode = presentMode;
+        _traits->swapchainPreferences.imageCount = imageCount;
+    }
+
+    // drops the requested image usages the surface does not support and
+    // keeps its present modes, before the first swapchain is built
+    void querySurfaceSupport()
+    {
+        VkPhysicalDevice physicalDevice = *getOrCreatePhysicalDevice();
+        VkSurfaceKHR surface = *getOrCreateSurface();
+
+        VkSurfaceCapabilitiesKHR capabilities;
+        if (vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physicalDevice, surface, &capabilities) == VK_SUCCESS)
+            _traits->swapchainPreferences.imageUsage &= capabilities.supportedUsageFlags;
+
+        uint32_t count = 0;
+        vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &count, nullptr);
+        std::vector<VkPresentModeKHR> presentModes(count);
+        vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &count, presentModes.data());
+
+        std::scoped_lock lock(_presentModesMutex);
+        _presentModes = presentModes;
+    }
+
+    // the mode vsg builds the swapchain with, it falls back to FIFO when the
+    // surface lacks the preferred one. Also called from the GUI thread.
+    VkPresentModeKHR presentModeFor(VkPresentModeKHR preferred) const
+    {
+        std::scoped_lock lock(_presentModesMutex);
+        if (_presentModes.empty() || std::find(_presentModes.begin(), _presentModes.end(), preferred) != _presentModes.end())
+            return preferred;
+
+        return VK_PRESENT_MODE_FIFO_KHR;
+    }
+
+    void rebuildSwapchain()
+    {
+        if (!_swapchain)
+            return;
+
+        vkDeviceWaitIdle(*_device);
+        buildSwapchain();
     }
 
     bool resized() const override
     {
-        const auto width = _window->width();
-        const auto height = _window->height();
-        return width != int(_extent2D.width) || height != int(_extent2D.height);
+        return _width != _appliedWidth || _height != _appliedHeight;
+    }
+
+    void resize() override
+    {
+        // vsg also calls this when the swapchain is out of date or suboptimal.
+        // The committed size is kept until the debounce timer commits the next
+        // one, only a surface that dictates its extent gets the native size.
+        const int committedWidth = _width;
+        const int committedHeight = _height;
+        _appliedWidth = committedWidth;
+        _appliedHeight = committedHeight;
+
+        int width = committedWidth;
+        int height = committedHeight;
+
+        VkSurfaceCapabilitiesKHR capabilities;
+        if (_surface && _physicalDevice && vkGetPhysicalDeviceSurfaceCapabilitiesKHR(*_physicalDevice, *_surface, &capabilities) == VK_SUCCESS &&
+            capabilities.currentExtent.width != 0xFFFFFFFF)
+        {
+            width = static_cast<int>(capabilities.currentExtent.width);
+            height = static_cast<int>(capabilities.currentExtent.height);
+        }
+
+        if (width <= 0 || height <= 0)
+            return;
+
+        _extent2D.width = width;
+        _extent2D.height = height;
+
+        buildSwapchain();
+    }
+
+    virtual const char* instanceExtensionSurfaceName() const override
+    {
+#if defined(VK_USE_PLATFORM_WIN32_KHR)
+        return VK_KHR_WIN32_SURFACE_EXTENSION_NAME;
+#elif defined(VK_USE_PLATFORM_XLIB_KHR)
+        return VK_KHR_XLIB_SURFACE_EXTENSION_NAME;
+#elif defined(VK_USE_PLATFORM_XCB_KHR)
+        return VK_KHR_XCB_SURFACE_EXTENSION_NAME;
+#endif
+    }
+
+
+    vsgQt::EventQueue bufferedEvents;
+    vsgQt::EventPool eventPool;
+
+protected:
+
+    virtual void _initSurface() override
+    {
+        //qCDebug(lc) << __func__ << _instance;
+
+        if (!_instance)
+            _initInstance();
+
+        _surface = new Surface(_window, _instance);
+    }
+
+    virtual ~Window() override
+    {
+        clear();
+    }
+
+    VulkanWindow *_window = nullptr;
+    std::atomic<int> _width{0};
+    std::atomic<int> _height{0};
+    std::atomic<int> _nativeWidth{0};
+    std::atomic<int> _nativeHeight{0};
+
+    // the committed size the swapchain was last built for, only used by the frame loop
+    int _appliedWidth{0};
+    int _appliedHeight{0};
+
+    // only used by the frame loop
+    vsg::clock::time_point _inputTime;
+    bool _hasInput{false};
+    size_t _reportedCoalesced{0};
+
+    // supported by the surface, empty until querySurfaceSupport()
+    mutable std::mutex _presentModesMutex;
+    std::vector<VkPresentModeKHR> _presentModes;
+};
+
+class KeyboardMap
+{
+public:
+    KeyboardMap();
+
+    bool getKeySymbol(const QKeyEvent *e, vsg::KeySymbol &keySymbol, vsg::KeySymbol &modifiedKeySymbol, vsg::KeyModifier &keyModifier);
+
+protected:
+    using VirtualKeyToKeySymbolMap = std::map<uint16_t, vsg::KeySymbol>;
+    VirtualKeyToKeySymbolMap _keycodeMap;
+};
+
+// Hands the window events of one window to its handler and drops those of
+// the other windows, so each view sharing the viewer has its own Trackball.
+class WindowEventFilter : public vsg::Inherit<vsg::Visitor, WindowEventFilter>
+{
+public:
+
+    WindowEventFilter(vsg::Window *window, vsg::ref_ptr<vsg::Visitor> handler)
+        : _window(window)
+        , _handler(handler)
+    {
+    }
+
+    void apply(vsg::UIEvent &event) override
+    {
+        event.accept(*_handler);
+    }
+
+    void apply(vsg::WindowEvent &event) override
+    {
+        vsg::ref_ptr<vsg::Window> window = event.window;
+        if (window.get() == _window)
+            event.accept(*_handler);
+    }
+
+    vsg::Window *window() const { return _window; }
+
+private:
+    vsg::Window *_window;
+    vsg::ref_ptr<vsg::Visitor> _handler;
+};
+
+static bool compileNode(vsgQt::SubgraphCompiler &compiler, vsg::Node *node)
+{
+    vsgQt::SubgraphCompiler::Stats stats;
+    if (!compiler.compile(node, &stats))
+        return false;
+
+    qCDebug(lc) << "Compiled model" << stats.modelIndex << "in" << stats.duration.count() << "ms," << stats.numDescriptorSets << "descriptor sets";
+    return true;
+}
+
+}
+
+// State shared by a VulkanWindow and every view created with it as shareWith:
+// the Vulkan instance and device, the scene graph with its compiled resources
+// and one vsg::Viewer that records and presents the command graphs of all
+// views per frame.
+struct VulkanWindow::Context
+{
+    Context();
+
+    std::unique_ptr<QVulkanInstance> instance{new QVulkanInstance()};
+    vsg::ref_ptr<vsg::Instance> vsgInstance;
+    vsg::ref_ptr<vsg::Viewer> viewer{vsg::Viewer::create()};
+    vsg::ref_ptr<vsg::Group> scenegraph{vsg::Group::create()};
+    vsg::ref_ptr<vsg::Group> modelRoot{vsg::Group::create()};
+
+    // with more than one recording thread modelRoot is recorded as partitions,
+    // each into its own secondary command buffer
+    uint32_t recordingThreads{1};
+    vsg::ref_ptr<vsg::Group> partitions{vsg::Group::create()};
+
+    // the window whose device the other views share
+    vsg::ref_ptr<vsgQt::Window> sharedWindow;
+
+    // views attached to the viewer, only changed between two frames. The
+    // first one drives the frame loop when it runs on the GUI thread.
+    std::mutex viewsMutex;
+    std::vector<VulkanWindow *> views;
+
+    // outlives the loader, which releases the reservations of loads cancelled on shutdown
+    vsgQt::MemoryBudget memoryBudget;
+    vsgQt::ModelLoader loader;
+    vsgQt::FrameProfiler profiler;
+    vsgQt::FrameCapture capture;
+    vsgQt::PipelineCache pipelineCache;
+    // set by stopCapture() until the frames still in flight are written
+    std::atomic<bool> captureStopping{false};
+    vsgQt::ShaderCache shaderCache;
+    vsgQt::BinaryCache binaryCache;
+    vsgQt::LodGenerator lodGenerator;
+    vsgQt::Picker picker;
+    std::atomic<int> nextPickId{1};
+    vsgQt::SceneBounds sceneBounds;
+    // bounds of the last hit picked in any view
+    std::mutex selectionMutex;
+    vsg::dbox selection;
+    std::atomic<bool> generateLevelsOfDetail{false};
+    vsgQt::SceneOptimizer optimizer;
+    std::atomic<bool> optimizeModels{false};
+    vsgQt::AutoInstancer instancer;
+    std::atomic<bool> instanceModels{false};
+    vsgQt::TextureCompressor textureCompressor;
+    std::atomic<bool> compressTextures{false};
+    // set when the device is created with block compressed texture support
+    std::atomic<bool> textureCompressionBC{false};
+    // counters of the last frame, summed over the views
+    std::atomic<bool> collectSceneStats{false};
+    std::mutex sceneStatsMutex;
+    vsgQt::SceneStats::Counters sceneStats;
+
+    // tiles of paged databases are read and compiled by the pager's threads
+    vsg::ref_ptr<vsg::DatabasePager> databasePager{vsg::DatabasePager::create()};
+    vsgQt::PagingBudget pagingBudget;
+    // models are read without the pager's measuring reader
+    vsg::ref_ptr<vsg::Options> modelOptions{vsg::Options::create()};
+    std::chrono::steady_clock::time_point lastProfileReport;
+    std::atomic<VulkanWindow::RenderMode> renderMode{VulkanWindow::RenderMode::OnDemand};
+    std::atomic<bool> dirty{true};
+    std::atomic<bool> animating{false};
+
+    // scene changes requested by the GUI thread, applied between two frames
+    std::mutex operationsMutex;
+    std::vector<std::function<void()>> operations;
+
+    // optional frame loop on a dedicated thread
+    bool threaded{false};
+    std::thread renderThread;
+    std::mutex frameMutex;
+    std::condition_variable frameCondition;
+    bool stopRendering{false};
+
+    VulkanWindow *driver() const { return views.empty() ? nullptr : views.front(); }
+
+    bool compileNode(vsg::Node *node);
+    void mergeLoadedModels();
+    void updatePartitions();
+
+    void attach(VulkanWindow *view, vsg::ref_ptr<vsg::Node> startupModel);
+    void detach(VulkanWindow *view);
+    void assignCommandGraphs();
+
+    void runBetweenFrames(std::function<void()> operation);
+    void runOperations();
+
+    void requestFrame();
+    bool renderFrame();
+    void startRenderThread();
+    void stopRenderThread();
+};
+
+struct VulkanWindow::Private
+{
+    std::shared_ptr<VulkanWindow::Context> context;
+    bool initialized{false};
+    VulkanWindow::ViewDirection viewDirection{VulkanWindow::ViewDirection::Front};
+    vsg::ref_ptr<vsgQt::Window> window;
+    vsg::ref_ptr<vsg::Camera> camera;
+    vsg::ref_ptr<vsg::LookAt> lookAt;
+    vsg::ref_ptr<vsg::ViewportState> viewport;
+    vsg::ref_ptr<vsg::CommandGraph> commandGraph;
+    VkClearColorValue clearColor{{0.2f, 0.2f, 0.4f, 1.0f}};
+    VkClearDepthStencilValue clearDepthStencil{1.0f, 0};
+    vsgQt::KeyboardMap keyboard;
+    std::shared_ptr<vsgQt::SubgraphCompiler> compiler{std::make_shared<vsgQt::SubgraphCompiler>()};
+    QTimer resizeTimer;
+    int resizeDebounce{100};
+    // the defaults of vsg's swapchain preferences
+    VulkanWindow::PresentMode presentMode{VulkanWindow::PresentMode::Mailbox};
+    int framesInFlight{3};
+
+    void updateClearValues(const VkClearColorValue &color, const VkClearDepthStencilValue &depthStencil);
+
+    void commitResize(VulkanWindow *owner);
+};
+
+VulkanWindow::Context::Context()
+{
+    scenegraph->addChild(modelRoot);
+
+    shaderCache.setDirectory(QDir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation)).filePath("shaders"));
+
+    binaryCache.setCacheDirectory(QDir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation)).filePath("binary"));
+
+    textureCompressor.setCacheDirectory(QDir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation)).filePath("textures"));
+
+    lodGenerator.setCacheDirectory(QDir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation)).filePath("lod"));
+    lodGenerator.setReadFunction([this](const QString &filename, vsg::ref_ptr<const vsg::Options> options) { return binaryCache.read(filename, options); });
+
+    loader.setReadFunction([this](const QString &filename) {
+        auto node = generateLevelsOfDetail ? lodGenerator.read(filename, modelOptions) : binaryCache.read(filename, modelOptions);
+
+        if (node)
+            pagingBudget.prepare(node);
+
+        if (node && optimizeModels)
+        {
+            const auto report = optimizer.apply(node);
+            qCDebug(lc) << "Optimized" << filename << "draw calls" << report.before.drawCalls << "->" << report.after.drawCalls
+                        << "state binds" << report.before.stateBinds << "->" << report.after.stateBinds;
+        }
+
+        if (node && instanceModels)
+        {
+            const auto report = instancer.apply(node);
+            if (report.instancedDraws > 0)
+                qCDebug(lc) << "Instanced" << report.replacedDraws << "draws of" << filename << "as" << report.instancedDraws;
+        }
+
+        if (node && compressTextures && textureCompressionBC)
+        {
+            const auto report = textureCompressor.apply(node);
+            if (report.textures > 0)
+                qCDebug(lc) << "Compressed" << report.textures << "textures of" << filename << "from" << report.sourceBytes << "to" << report.compressedBytes << "bytes," << report.cached << "from the cache";
+        }
+
+        // the final model's bounds, so adding it to the scene does not traverse it again
+        if (node)
+            sceneBounds.prepare(node);
+
+        return node;
+    });
+    loader.setCompileFunction([this](vsg::Node *node) { return compileNode(node); });
+    loader.setReleaseFunction([this](vsg::Node *node) { memoryBudget.release(node); });
+}
+
+bool VulkanWindow::Context::compileNode(vsg::Node *node)
+{
+    // the views share the device and their render passes are alike, so the
+    // objects one view compiles serve all of them
+    std::shared_ptr<vsgQt::SubgraphCompiler> compiler;
+    {
+        std::scoped_lock lock(viewsMutex);
+        for (auto view : views)
+        {
+            if (view->p->compiler->valid())
+            {
+                compiler = view->p->compiler;
+                break;
+            }
+        }
+    }
+
+    if (!compiler)
+        return false;
+
+    // refuse models that do not fit, after trying them without mipmaps
+    auto usage = vsgQt::estimateMemory(node);
+    if (!memoryBudget.reserve(vsg::ref_ptr<const vsg::Node>(node), usage))
+    {
+        if (vsgQt::dropMipmaps(node))
+        {
+            qCWarning(lc) << "Model needs" << usage.total() << "bytes of device memory, dropping mipmaps to fit the budget";
+            usage = vsgQt::estimateMemory(node);
+        }
+
+        if (!memoryBudget.reserve(vsg::ref_ptr<const vsg::Node>(node), usage))
+        {
+            qCWarning(lc) << "Model needs" << usage.total() << "bytes of device memory and exceeds the budget";
+            return false;
+        }
+    }
+
+    // GLSL only shaders get their SPIR-V from the cache, or compiled once for it
+    vsgQt::ShaderCache::Stats shaderStats;
+    if (!shaderCache.prepare(node, &shaderStats))
+    {
+        memoryBudget.release(node);
+        return false;
+    }
+
+    if (shaderStats.compiled > 0 || shaderStats.memoryHits > 0 || shaderStats.diskHits > 0)
+        qCDebug(lc) << "Shaders:" << shaderStats.memoryHits << "memory hits," << shaderStats.diskHits << "disk hits," << shaderStats.compiled << "compiled";
+
+    if (!vsgQt::compileNode(*compiler, node))
+    {
+        memoryBudget.release(node);
+        return false;
+    }
+
+    memoryBudget.compiled(node);
+    return true;
+}
+
+void VulkanWindow::Private::updateClearValues(const VkClearColorValue &color, const VkClearDepthStencilValue &depthStencil)
+{
+    if (!commandGraph)
+        return;
+
+    // the RenderGraph picks up clearValues when recording the next frame, so
+    // neither the render pass nor any pipeline has to be recreated
+    for (auto &child : commandGraph->getChildren())
+    {
+        if (auto renderGraph = child->cast<vsg::RenderGraph>(); renderGraph && !renderGraph->clearValues.empty())
+        {
+            // vsg lays out the color attachments first and the depth attachment last
+            auto &clearValues = renderGraph->clearValues;
+            for (size_t i = 0; i + 1 < clearValues.size(); ++i)
+                clearValues[i].color = color;
+
+            clearValues.back().depthStencil = depthStencil;
+        }
+    }
+}
+
+void VulkanWindow::Context::mergeLoadedModels()
+{
+    auto completed = loader.takeCompleted();
+
+    for (auto &result : completed)
+    {
+        qCDebug(lc) << "Adding node to scene" << result.filename;
+
+        modelRoot->addChild(result.node);
+        memoryBudget.setName(result.node, result.filename);
+        picker.add(result.node);
+        sceneBounds.add(result.node);
+        loader.notifyMerged(result);
+    }
+
+    if (!completed.empty())
+        updatePartitions();
+}
+
+void VulkanWindow::Context::updatePartitions()
+{
+    if (recordingThreads > 1)
+        partitions->getChildren() = vsgQt::partitionScene(modelRoot, recordingThreads);
+}
+
+void VulkanWindow::Context::attach(VulkanWindow *view, vsg::ref_ptr<vsg::Node> startupModel)
+{
+    auto &v = *view->p;
+    const bool first = views.empty();
+
+    v.window->querySurfaceSupport();
+
+    // the bounds of the models in the scene are cached, only a startup model is new
+    auto bounds = sceneBounds.bounds();
+    if (startupModel)
+    {
+        const auto startupBounds = sceneBounds.prepare(startupModel);
+        if (startupBounds.valid())
+        {
+            bounds.add(startupBounds.min);
+            bounds.add(startupBounds.max);
+        }
+    }
+
+    vsg::dvec3 eyeDirection(0.0, -1.0, 0.0);
+    vsg::dvec3 up(0.0, 0.0, 1.0);
+    switch (v.viewDirection)
+    {
+    case ViewDirection::Front: break;
+    case ViewDirection::Top: eyeDirection.set(0.0, 0.0, 1.0); up.set(0.0, 1.0, 0.0); break;
+    case ViewDirection::Side: eyeDirection.set(1.0, 0.0, 0.0); break;
+    case ViewDirection::Perspective: eyeDirection.set(1.0, -1.0, 1.0); break;
+    }
+
+    // set up the camera
+    auto cameraSetup = vsgQt::createCamera(bounds, scenegraph, v.window->extent2D(), eyeDirection, up);
+    v.lookAt = cameraSetup.lookAt;
+    v.viewport = cameraSetup.viewport;
+    v.camera = cameraSetup.camera;
+
+    v.window->clearColor() = v.clearColor;
+
+    if (recordingThreads > 1)
+    {
+        // the same render pass set up, recorded from partitions on several threads
+        auto renderGraph = vsg::createRenderGraphForView(v.window, v.camera, scenegraph);
+        v.commandGraph = vsg::CommandGraph::create(v.window);
+        v.commandGraph->addChild(vsgQt::ParallelRenderGraph::create(*renderGraph, partitions, recordingThreads));
+    }
+    else
+    {
+        v.commandGraph = vsg::createCommandGraphForView(v.window, v.camera, scenegraph);
+    }
+    v.updateClearValues(v.clearColor, v.clearDepthStencil);
+
+    // GPU timings and frame capture cover the first view
+    if (first)
+    {
+        profiler.setupGpuTimer(v.window->getOrCreateDevice(), v.commandGraph, static_cast<uint32_t>(v.window->numFrames()));
+        capture.setup(v.window, v.commandGraph);
+    }
+
+    viewer->addWindow(v.window);
+    viewer->addEventHandler(vsgQt::WindowEventFilter::create(v.window, vsg::Trackball::create(v.camera)));
+
+    {
+        std::scoped_lock lock(viewsMutex);
+        views.push_back(view);
+    }
+
+    assignCommandGraphs();
+
+    // compile the Vulkan objects, this is the only whole-viewer compile. Later
+    // views only compile what they add on top of the shared scene.
+    if (first)
+    {
+        // loaded and kept for the device, see PipelineCache for what reaches it
+        pipelineCache.setup(v.window->getOrCreateDevice(), QStandardPaths::writableLocation(QStandardPaths::CacheLocation));
+        memoryBudget.setup(vsgInstance->getInstance(), *v.window->getOrCreatePhysicalDevice());
+        viewer->compile();
+    }
+
+    // models, including the startup one, are compiled on their own
+    v.compiler->setup(v.window, v.viewport);
+
+    if (!first)
+        vsgQt::compileNode(*v.compiler, v.commandGraph);
+
+    if (startupModel && compileNode(startupModel))
+    {
+        qCDebug(lc) << "Adding startup model to scene";
+        modelRoot->addChild(startupModel);
+        memoryBudget.setName(startupModel, "models/teapot.vsgt");
+        picker.add(startupModel);
+        sceneBounds.add(startupModel);
+        updatePartitions();
+    }
+}
+
+void VulkanWindow::Context::detach(VulkanWindow *view)
+{
+    const bool restart = renderThread.joinable();
+    stopRenderThread();
+
+    // a view exposed just before may still wait to be attached
+    runOperations();
+
+    auto &v = *view->p;
+    if (auto itr = std::find(views.begin(), views.end(), view); itr != views.end())
+    {
+        const bool first = itr == views.begin();
+        {
+            std::scoped_lock lock(viewsMutex);
+            views.erase(itr);
+        }
+
+        auto &windows = viewer->windows();
+        windows.erase(std::remove(windows.begin(), windows.end(), v.window), windows.end());
+
+        auto &handlers = viewer->getEventHandlers();
+        handlers.erase(std::remove_if(handlers.begin(), handlers.end(), [&](const vsg::ref_ptr<vsg::Visitor> &handler) {
+            auto filter = handler->cast<vsgQt::WindowEventFilter>();
+            return filter && filter->window() == v.window.get();
+        }), handlers.end());
+
+        if (first)
+        {
+            // a recording of the view ends with it
+            const bool recording = capture.isRecording() || captureStopping;
+
+            profiler.releaseGpuTimer();
+            capture.release();
+
+            // the next view takes over GPU timings and frame capture
+            if (!views.empty())
+            {
+                auto &front = *views.front()->p;
+                profiler.setupGpuTimer(front.window->getOrCreateDevice(), front.commandGraph, static_cast<uint32_t>(front.window->numFrames()));
+                capture.setup(front.window, front.commandGraph);
+            }
+
+            if (recording)
+            {
+                captureStopping = false;
+                for (auto remaining : views)
+                    emit remaining->captureFinished();
+            }
+        }
+
+        if (sharedWindow == v.window)
+            sharedWindow = views.empty() ? vsg::ref_ptr<vsgQt::Window>() : views.front()->p->window;
+
+        v.compiler->release();
+
+        assignCommandGraphs();
+
+        if (views.empty())
+        {
+            if (!pipelineCache.save())
+                qCWarning(lc) << "Could not write pipeline cache" << pipelineCache.filename();
+            pipelineCache.release();
+        }
+    }
+
+    if (restart && !views.empty())
+        startRenderThread();
+}
+
+void VulkanWindow::Context::assignCommandGraphs()
+{
+    vsg::CommandGraphs commandGraphs;
+    for (auto view : views)
+        commandGraphs.push_back(view->p->commandGraph);
+
+    viewer->recordAndSubmitTasks.clear();
+    viewer->presentations.clear();
+
+    if (commandGraphs.empty())
+        return;
+
+    // one submission and one present for all views, with several command
+    // graphs setupThreading() records each of them on its own thread
+    viewer->assignRecordAndSubmitTaskAndPresentation(commandGraphs, databasePager);
+    viewer->setupThreading();
+}
+
+void VulkanWindow::Context::runBetweenFrames(std::function<void()> operation)
+{
+    std::scoped_lock lock(operationsMutex);
+    operations.push_back(std::move(operation));
+}
+
+void VulkanWindow::Context::runOperations()
+{
+    std::vector<std::function<void()>> pending;
+    {
+        std::scoped_lock lock(operationsMutex);
+        pending.swap(operations);
+    }
+
+    for (auto &operation : pending)
+        operation();
+}
+
+void VulkanWindow::Context::requestFrame()
+{
+    {
+        std::scoped_lock lock(frameMutex);
+        dirty = true;
+    }
+
+    if (renderThread.joinable())
+        frameCondition.notify_one();
+    else if (auto view = driver())
+        view->requestUpdate();
+}
+
+bool VulkanWindow::Context::renderFrame()
+{
+    dirty = false;
+
+    runOperations();
+
+    using clock = std::chrono::steady_clock;
+    auto last = clock::now();
+    auto lap = [&](vsgQt::FrameProfiler::Stage stage) {
+        const auto now = clock::now();
+        profiler.add(stage, std::chrono::duration<double, std::milli>(now - last).count());
+        last = now;
+    };
+
+    // keep rendering while a camera moves on its own, e.g. a thrown Trackball
+    auto cameras = [this]() {
+        std::vector<vsg::dvec3> state;
+        for (auto view : views)
+        {
+            if (auto &lookAt = view->p->lookAt)
+            {
+                state.push_back(lookAt->eye);
+                state.push_back(lookAt->center);
+                state.push_back(lookAt->up);
+            }
+        }
+        return state;
+    };
+
+    profiler.beginFrame();
+
+    if (viewer->advanceToNextFrame())
+    {
+        lap(vsgQt::FrameProfiler::Advance);
+
+        mergeLoadedModels();
+
+        const auto before = cameras();
+
+        viewer->handleEvents();
+        lap(vsgQt::FrameProfiler::Events);
+
+        viewer->update();
+        pagingBudget.apply(databasePager);
+        lap(vsgQt::FrameProfiler::Update);
+
+        // a traversal of its own, with the cameras this frame records with
+        if (collectSceneStats)
+        {
+            vsgQt::SceneStats::Counters counters;
+            for (auto view : views)
+            {
+                if (auto &camera = view->p->camera)
+                    counters += vsgQt::SceneStats::collect(scenegraph, camera->projectionMatrix->transform(), camera->viewMatrix->transform());
+            }
+
+            std::scoped_lock lock(sceneStatsMutex);
+            sceneStats = counters;
+        }
+        lap(vsgQt::FrameProfiler::SceneStatistics);
+
+        if (cameras() != before)
+            dirty = true;
+
+        viewer->recordAndSubmit();
+        lap(vsgQt::FrameProfiler::RecordAndSubmit);
+
+        viewer->present();
+        lap(vsgQt::FrameProfiler::Present);
+
+        // copies of earlier frames the GPU is done with go to the encoders
+        capture.collect();
+
+        // a stopped recording is done once the last frame in flight is written
+        if (captureStopping && !capture.isBusy())
+        {
+            captureStopping = false;
+            for (auto view : views)
+                emit view->captureFinished();
+        }
+
+        // from the earliest input handled by this frame to its present
+        vsg::clock::time_point inputTime;
+        bool input = false;
+        for (auto view : views)
+        {
+            vsg::clock::time_point time;
+            if (view->p->window->takeInputTime(time) && (!input || time < inputTime))
+            {
+                inputTime = time;
+                input = true;
+            }
+        }
+
+        if (input)
+            profiler.set(vsgQt::FrameProfiler::InputLatency, std::chrono::duration<double, std::milli>(vsg::clock::now() - inputTime).count());
+
+        profiler.endFrame();
+
+        if (last - lastProfileReport > std::chrono::milliseconds(500))
+        {
+            lastProfileReport = last;
+
+            const auto text = profiler.summaryText();
+            for (auto view : views)
+                emit view->frameProfileUpdated(text);
+        }
+    }
+
+    const bool pending = std::any_of(views.begin(), views.end(), [](VulkanWindow *view) { return !view->p->window->bufferedEvents.empty(); });
+    // tiles that are still being read are merged by a later frame's update
+    const bool paging = databasePager->numActiveRequests > 0;
+    return renderMode == RenderMode::Continuous || animating || dirty || pending || paging || captureStopping || loader.hasCompleted();
+}
+
+void VulkanWindow::Context::startRenderThread()
+{
+    stopRendering = false;
+
+    renderThread = std::thread([this]() {
+        bool nextFrame = true;
+        for (;;)
+        {
+            {
+                std::unique_lock lock(frameMutex);
+                frameCondition.wait(lock, [&]() { return stopRendering || nextFrame || dirty; });
+                if (stopRendering)
+                    break;
+            }
+
+            nextFrame = renderFrame();
+        }
+    });
+}
+
+void VulkanWindow::Context::stopRenderThread()
+{
+    if (!renderThread.joinable())
+        return;
+
+    {
+        std::scoped_lock lock(frameMutex);
+        stopRendering = true;
+    }
+    frameCondition.notify_one();
+    renderThread.join();
+
+    // let the frames in flight finish before Qt or vsg release anything
+    if (sharedWindow && sharedWindow->getDevice())
+        vkDeviceWaitIdle(*sharedWindow->getDevice());
+}
+
+VulkanWindow::VulkanWindow(VulkanWindow *shareWith)
+    : QWindow()
+    , p(new Private)
+{   
+    setSurfaceType(VulkanSurface);
+
+    p->context = shareWith ? shareWith->p->context : std::make_shared<Context>();
+
+    p->resizeTimer.setSingleShot(true);
+    connect(&p->resizeTimer, &QTimer::timeout, this, [this]() {
+        p->commitResize(this);
+        requestRender();
+    });
+
+    auto &loader = p->context->loader;
+    connect(&loader, &vsgQt::ModelLoader::loadStarted, this, &VulkanWindow::loadStarted);
+    connect(&loader, &vsgQt::ModelLoader::loadProgress, this, &VulkanWindow::loadProgress);
+    connect(&loader, &vsgQt::ModelLoader::loadCompleted, this, &VulkanWindow::requestRender);
+    connect(&loader, &vsgQt::ModelLoader::loadMerged, this, [this](int id, const QString &filename) {
+        emit loadFinished(id, filename, true);
+    });
+    connect(&loader, &vsgQt::ModelLoader::loadFailed, this, [this](int id, const QString &filename) {
+        emit loadFinished(id, filename, false);
+    });
+}
+
+QColor VulkanWindow::clearColor() const
+{
+    if (p->window.valid())
+    {
+        const auto &clear = p->clearColor;
+        return QColor::fromRgbF(clear.float32[0], clear.float32[1], clear.float32[2], clear.float32[3]);
     }
 
-    void resize() override
-    {
-        const auto width = _window->width();
-        const auto height = _window->height();
+    return {};
+}
 
-        _extent2D.width = width;
-        _extent2D.height = height;
+VulkanWindow::~VulkanWindow()
+{
+    if (p->initialized)
+        p->context->detach(this);
+}
 
-        buildSwapchain();
-    }
+bool VulkanWindow::isThreadedRendering() const
+{
+    return p->context->threaded;
+}
 
-    virtual const char* instanceExtensionSurfaceName() const override
-    {
-#if defined(VK_USE_PLATFORM_WIN32_KHR)
-        return VK_KHR_WIN32_SURFACE_EXTENSION_NAME;
-#elif defined(VK_USE_PLATFORM_XLIB_KHR)
-        return VK_KHR_XLIB_SURFACE_EXTENSION_NAME;
-#elif defined(VK_USE_PLATFORM_XCB_KHR)
-        return VK_KHR_XCB_SURFACE_EXTENSION_NAME;
-#endif
-    }
+void VulkanWindow::setThreadedRendering(bool threaded)
+{
+    // the frame loop is set up once, when the first view is exposed
+    if (!p->context->sharedWindow)
+        p->context->threaded = threaded;
+}
+
+bool VulkanWindow::isLevelOfDetailEnabled() const
+{
+    return p->context->generateLevelsOfDetail;
+}
 
+void VulkanWindow::setLevelOfDetailEnabled(bool enabled)
+{
+    // applies to the models loaded from now on
+    p->context->generateLevelsOfDetail = enabled;
+}
 
-    vsg::UIEvents bufferedEvents;
+bool VulkanWindow::isSceneOptimizationEnabled() const
+{
+    return p->context->optimizeModels;
+}
 
-protected:
+void VulkanWindow::setSceneOptimizationEnabled(bool enabled)
+{
+    // applies to the models loaded from now on
+    p->context->optimizeModels = enabled;
+}
 
-    virtual void _initSurface() override
-    {
-        //qCDebug(lc) << __func__ << _instance;
+bool VulkanWindow::isAutoInstancingEnabled() const
+{
+    return p->context->instanceModels;
+}
 
-        if (!_instance)
-            _initInstance();
+void VulkanWindow::setAutoInstancingEnabled(bool enabled)
+{
+    // applies to the models loaded from now on
+    p->context->instanceModels = enabled;
+}
 
-        _surface = new Surface(_window, _instance);
-    }
+bool VulkanWindow::isTextureCompressionEnabled() const
+{
+    return p->context->compressTextures;
+}
 
-    virtual ~Window() override
+void VulkanWindow::setTextureCompressionEnabled(bool enabled)
+{
+    // applies to the models loaded from now on, on devices that support BC formats
+    p->context->compressTextures = enabled;
+}
+
+bool VulkanWindow::isSceneStatisticsEnabled() const
+{
+    return p->context->collectSceneStats;
+}
+
+void VulkanWindow::setSceneStatisticsEnabled(bool enabled)
+{
+    p->context->collectSceneStats = enabled;
+    if (!enabled)
     {
-        clear();
+        std::scoped_lock lock(p->context->sceneStatsMutex);
+        p->context->sceneStats = {};
     }
+}
 
-    VulkanWindow *_window = nullptr;
-};
+VulkanWindow::SceneStatistics VulkanWindow::sceneStatistics() const
+{
+    std::scoped_lock lock(p->context->sceneStatsMutex);
+    const auto &counters = p->context->sceneStats;
+    return {static_cast<qint64>(counters.drawCalls), static_cast<qint64>(counters.indexedPrimitives), static_cast<qint64>(counters.pipelineBinds),
+            static_cast<qint64>(counters.descriptorBinds), static_cast<qint64>(counters.culledNodes)};
+}
 
-class KeyboardMap
+qint64 VulkanWindow::pagingBudget() const
 {
-public:
-    KeyboardMap();
+    return static_cast<qint64>(p->context->pagingBudget.budget());
+}
 
-    bool getKeySymbol(const QKeyEvent *e, vsg::KeySymbol &keySymbol, vsg::KeySymbol &modifiedKeySymbol, vsg::KeyModifier &keyModifier);
+void VulkanWindow::setPagingBudget(qint64 bytes)
+{
+    p->context->pagingBudget.setBudget(static_cast<size_t>(std::max<qint64>(0, bytes)));
+}
 
-protected:
-    using VirtualKeyToKeySymbolMap = std::map<uint16_t, vsg::KeySymbol>;
-    VirtualKeyToKeySymbolMap _keycodeMap;
-};
+QVector<VulkanWindow::ModelMemory> VulkanWindow::modelMemory() const
+{
+    QVector<ModelMemory> models;
+    for (auto &model : p->context->memoryBudget.models())
+    {
+        models.append({
+            model.name,
+            static_cast<qint64>(model.usage.vertex),
+            static_cast<qint64>(model.usage.index),
+            static_cast<qint64>(model.usage.texture),
+            static_cast<qint64>(model.usage.descriptor)
+        });
+    }
+    return models;
+}
 
+qint64 VulkanWindow::deviceMemoryBudget() const
+{
+    uint64_t budget = 0, usage = 0;
+    p->context->memoryBudget.query(budget, usage);
+    return static_cast<qint64>(budget);
 }
 
-struct VulkanWindow::Private
+qint64 VulkanWindow::deviceMemoryUsage() const
 {
-    QVulkanInstance *instance{new QVulkanInstance()};
-    bool initialized{false};
-    vsg::ref_ptr<vsg::Instance> vsgInstance;
-    vsg::ref_ptr<vsg::Viewer> viewer{vsg::Viewer::create()};
-    vsg::ref_ptr<vsg::Group> scenegraph{vsg::Group::create()};
-    vsg::ref_ptr<vsg::Group> modelRoot{vsg::Group::create()};
-    vsg::ref_ptr<vsgQt::Window> window;
-    vsg::ref_ptr<vsg::Camera> camera;
-    vsg::ref_ptr<vsg::ViewportState> viewport;
-    vsg::ref_ptr<vsg::CommandGraph> commandGraph;
-    VkClearColorValue clearColor;
-    vsgQt::KeyboardMap keyboard;
-    vsg::ref_ptr<vsg::CompileTraversal> compile;
-};
+    uint64_t budget = 0, usage = 0;
+    p->context->memoryBudget.query(budget, usage);
+    return static_cast<qint64>(usage);
+}
 
-VulkanWindow::VulkanWindow()
-    : QWindow()
-    , p(new Private)
-{   
-    setSurfaceType(VulkanSurface);
+qint64 VulkanWindow::memoryLimit() const
+{
+    return static_cast<qint64>(p->context->memoryBudget.limit());
+}
 
-    p->scenegraph->addChild(p->modelRoot);
+void VulkanWindow::setMemoryLimit(qint64 bytes)
+{
+    p->context->memoryBudget.setLimit(static_cast<uint64_t>(std::max<qint64>(0, bytes)));
 }
 
-QColor VulkanWindow::clearColor() const
+int VulkanWindow::recordingThreads() const
 {
-    if (p->window.valid())
-    {
-        const auto clear = p->window->clearColor();
-        return QColor::fromRgbF(clear.float32[0], clear.float32[1], clear.float32[2], clear.float32[3]);
-    }
+    return static_cast<int>(p->context->recordingThreads);
+}
 
-    return {};
+void VulkanWindow::setRecordingThreads(int numThreads)
+{
+    // the command graphs are set up when the first view is exposed
+    if (!p->context->sharedWindow)
+        p->context->recordingThreads = static_cast<uint32_t>(std::max(1, numThreads));
+}
+
+VulkanWindow::ViewDirection VulkanWindow::viewDirection() const
+{
+    return p->viewDirection;
 }
 
-VulkanWindow::~VulkanWindow() = default;
+void VulkanWindow::setViewDirection(ViewDirection direction)
+{
+    // the camera is set up when the window is exposed for the first time
+    if (!p->initialized)
+        p->viewDirection = direction;
+}
 
 void VulkanWindow::exposeEvent(QExposeEvent *e)
 {
@@ -205,6 +1233,8 @@ void VulkanWindow::exposeEvent(QExposeEvent *e)
         {
             p->initialized = true;
 
+            auto &context = *p->context;
+
             const auto rect = e->region().boundingRect();
             const uint32_t width = static_cast<uint32_t>(rect.width());
             const uint32_t height = static_cast<uint32_t>(rect.height());
@@ -218,81 +1248,84 @@ void VulkanWindow::exposeEvent(QExposeEvent *e)
             windowTraits->fullscreen = false;
             windowTraits->samples = 4;
 
+            // frame capture copies from the swapchain images, where the surface allows it
+            windowTraits->swapchainPreferences.imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+
+            // views after the first one use its instance and device
+            const bool first = !context.sharedWindow;
+            if (!first)
+                windowTraits->shareWindow = context.sharedWindow;
+
             p->window = new vsgQt::Window(this, windowTraits);
+            p->window->setSwapchainPreferences(vsgQt::toVkPresentMode(p->presentMode), static_cast<uint32_t>(p->framesInFlight));
+
+            if (!context.vsgInstance)
+            {
+                vsg::Names instanceExtensions;
+                instanceExtensions.push_back("VK_KHR_surface");
+                instanceExtensions.push_back(p->window->instanceExtensionSurfaceName());
+                //instanceExtensions.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
 
-            vsg::Names instanceExtensions;
-            instanceExtensions.push_back("VK_KHR_surface");
-            instanceExtensions.push_back(p->window->instanceExtensionSurfaceName());
-            //instanceExtensions.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
+                vsg::Names requestedLayers;
+                //requestedLayers.push_back("VK_LAYER_KHRONOS_validation");
+                //requestedLayers.push_back("VK_LAYER_LUNARG_api_dump");
 
-            vsg::Names requestedLayers;
-            //requestedLayers.push_back("VK_LAYER_KHRONOS_validation");
-            //requestedLayers.push_back("VK_LAYER_LUNARG_api_dump");
+                vsg::Names validatedNames = vsg::validateInstancelayerNames(requestedLayers);
 
-            vsg::Names validatedNames = vsg::validateInstancelayerNames(requestedLayers);
+                context.vsgInstance = vsg::Instance::create(instanceExtensions, validatedNames);
 
-            p->vsgInstance = vsg::Instance::create(instanceExtensions, validatedNames);
+                context.instance->setVkInstance(context.vsgInstance->getInstance());
+                context.instance->create();
+            }
 
-            p->instance->setVkInstance(p->vsgInstance->getInstance());
-            if (p->instance->create())
+            if (context.instance->isValid())
             {
                 qCDebug(lc) << __func__<< "success.";
-                setVulkanInstance(p->instance);
-
-                p->viewer->addWindow(p->window);
-
-#if 1
-                vsg::Paths searchPaths = vsg::getEnvPaths("VSG_FILE_PATH");
-                vsg::Path filename = vsg::findFile("models/teapot.vsgt", searchPaths);
+                setVulkanInstance(context.instance.get());
 
-                if (auto node = vsg::read_cast<vsg::Node>(filename); node.valid())
+                if (first)
                 {
-                    qCDebug(lc) << "Adding node to scene" << filename.c_str();
-                    p->modelRoot->addChild(node);
-                }
-#endif
+                    context.sharedWindow = p->window;
 
-                // compute the bounds of the scene graph to help position camera
-                vsg::ComputeBounds computeBounds;
-                p->scenegraph->accept(computeBounds);
-                vsg::dvec3 centre = (computeBounds.bounds.min+computeBounds.bounds.max)*0.5;
-                double radius = vsg::length(computeBounds.bounds.max-computeBounds.bounds.min)*0.6;
-                double nearFarRatio = 0.001;
+                    // the device is created with the first view, compressed textures need it enabled
+                    context.textureCompressionBC = vsgQt::TextureCompressor::isSupported(context.vsgInstance->getInstance());
+                    if (context.textureCompressionBC)
+                    {
+                        windowTraits->deviceFeatures = vsg::DeviceFeatures::create();
+                        windowTraits->deviceFeatures->get().textureCompressionBC = VK_TRUE;
+                    }
 
-                // set up the camera
-                auto lookAt = vsg::LookAt::create(centre+vsg::dvec3(0.0, -radius*3.5, 0.0), centre, vsg::dvec3(0.0, 0.0, 1.0));
+                    vsg::ref_ptr<vsg::Node> model;
+#if 1
+                    model = vsgQt::readStartupModel();
+#endif
 
-                vsg::ref_ptr<vsg::ProjectionMatrix> perspective;
-                if (vsg::ref_ptr<vsg::EllipsoidModel> ellipsoidModel(p->scenegraph->getObject<vsg::EllipsoidModel>("EllipsoidModel")); ellipsoidModel)
+                    context.attach(this, model);
+                }
+                else if (context.renderThread.joinable())
                 {
-                    perspective = vsg::EllipsoidPerspective::create(lookAt, ellipsoidModel, 30.0, static_cast<double>(p->window->extent2D().width) / static_cast<double>(p->window->extent2D().height), nearFarRatio, 0.0);
+                    // the frame loop is running, hook the view in between two frames
+                    context.runBetweenFrames([this]() { p->context->attach(this, {}); });
                 }
                 else
                 {
-                    perspective = vsg::Perspective::create(30.0, static_cast<double>(p->window->extent2D().width) / static_cast<double>(p->window->extent2D().height), nearFarRatio*radius, radius * 4.5);
+                    context.attach(this, {});
                 }
 
-                p->viewport = vsg::ViewportState::create(p->window->extent2D());
-                p->camera = vsg::Camera::create(perspective, lookAt, p->viewport);
-
-                //p->window->clearColor() = p->clearColor;
-
-                p->commandGraph = vsg::createCommandGraphForView(p->window, p->camera, p->scenegraph);
-
-                p->viewer->assignRecordAndSubmitTaskAndPresentation({p->commandGraph});
-
-                p->viewer->addEventHandler(vsg::Trackball::create(p->camera));
-
-                p->viewer->setupThreading();
-
-                // compile the Vulkan objects
-                p->viewer->compile();
-
                 vsg::clock::time_point event_time = vsg::clock::now();
-                p->window->bufferedEvents.emplace_back(new vsg::ExposeWindowEvent(p->window, event_time, rect.x(), rect.y(), width, height));
+                p->window->bufferedEvents.push(vsg::ExposeWindowEvent::create(p->window, event_time, rect.x(), rect.y(), width, height));
             }
 
-            render();
+            if (first && context.threaded)
+                context.startRenderThread();
+            else if (first)
+                render();
+            else
+                requestRender();
+        }
+        else
+        {
+            requestRender();
         }
     }
 }
@@ -302,7 +1335,17 @@ bool VulkanWindow::event(QEvent *e)
     switch (e->type())
     {
     case QEvent::UpdateRequest:
-        render();
+        // the first view renders the frame of all views
+        if (!p->context->renderThread.joinable() && p->context->driver() == this)
+            render();
+        break;
+
+    case QEvent::PlatformSurface:
+        if (static_cast<QPlatformSurfaceEvent *>(e)->surfaceEventType() == QPlatformSurfaceEvent::SurfaceAboutToBeDestroyed && p->initialized)
+        {
+            p->context->detach(this);
+            p->initialized = false;
+        }
         break;
 
     default:
@@ -323,7 +1366,8 @@ void VulkanWindow::keyPressEvent(QKeyEvent *e)
     if (p->keyboard.getKeySymbol(e, keySymbol, modifiedKeySymbol, keyModifier))
     {
         vsg::clock::time_point event_time = vsg::clock::now();
-        p->window->bufferedEvents.emplace_back(new vsg::KeyPressEvent(p->window, event_time, keySymbol, modifiedKeySymbol, keyModifier));
+        p->window->bufferedEvents.push(vsg::KeyPressEvent::create(p->window, event_time, keySymbol, modifiedKeySymbol, keyModifier));
+        requestRender();
     }
 }
 
@@ -335,7 +1379,8 @@ void VulkanWindow::keyReleaseEvent(QKeyEvent *e)
     if (p->keyboard.getKeySymbol(e, keySymbol, modifiedKeySymbol, keyModifier))
     {
         vsg::clock::time_point event_time = vsg::clock::now();
-        p->window->bufferedEvents.emplace_back(new vsg::KeyReleaseEvent(p->window, event_time, keySymbol, modifiedKeySymbol, keyModifier));
+        p->window->bufferedEvents.push(vsg::KeyReleaseEvent::create(p->window, event_time, keySymbol, modifiedKeySymbol, keyModifier));
+        requestRender();
     }
 }
 
@@ -353,7 +1398,9 @@ void VulkanWindow::mouseMoveEvent(QMouseEvent *e)
     default: button = 0; break;
     }
 
-    p->window->bufferedEvents.emplace_back(new vsg::MoveEvent(p->window, event_time, e->x(), e->y(), (vsg::ButtonMask)button));
+    p->window->bufferedEvents.push(p->window->eventPool.moveEvent(p->window, event_time, e->x(), e->y(), (vsg::ButtonMask)button));
+
+    requestRender();
 }
 
 void VulkanWindow::mousePressEvent(QMouseEvent *e)
@@ -370,7 +1417,14 @@ void VulkanWindow::mousePressEvent(QMouseEvent *e)
     default: button = 0; break;
     }
 
-    p->window->bufferedEvents.emplace_back(new vsg::ButtonPressEvent(p->window, event_time, e->x(), e->y(), (vsg::ButtonMask)button, 0));
+    p->window->bufferedEvents.push(vsg::ButtonPressEvent::create(p->window, event_time, e->x(), e->y(), (vsg::ButtonMask)button, 0));
+
+    requestRender();
+}
+
+void VulkanWindow::mouseDoubleClickEvent(QMouseEvent *e)
+{
+    pick(e->pos());
 }
 
 void VulkanWindow::mouseReleaseEvent(QMouseEvent *e)
@@ -387,15 +1441,42 @@ void VulkanWindow::mouseReleaseEvent(QMouseEvent *e)
     default: button = 0; break;
     }
 
-    p->window->bufferedEvents.emplace_back(new vsg::ButtonReleaseEvent(p->window, event_time, e->x(), e->y(), (vsg::ButtonMask)button, 0));
+    p->window->bufferedEvents.push(vsg::ButtonReleaseEvent::create(p->window, event_time, e->x(), e->y(), (vsg::ButtonMask)button, 0));
+
+    requestRender();
 }
 
 void VulkanWindow::resizeEvent(QResizeEvent *e)
 {
+    if (p->initialized)
+    {
+        // keep presenting the current swapchain, scaled by the platform, while
+        // the size keeps changing and rebuild it once the resize has settled
+        p->window->setNativeExtent(e->size().width(), e->size().height());
+        p->resizeTimer.start(p->resizeDebounce);
+        requestRender();
+    }
+}
+
+void VulkanWindow::Private::commitResize(VulkanWindow *owner)
+{
+    if (!window)
+        return;
+
+    window->commitExtent();
+
     vsg::clock::time_point event_time = vsg::clock::now();
+    window->bufferedEvents.push(vsg::ConfigureWindowEvent::create(window, event_time, owner->x(), owner->y(), static_cast<uint32_t>(owner->width()), static_cast<uint32_t>(owner->height())));
+}
 
-    if (p->initialized)
-        p->window->bufferedEvents.emplace_back(new vsg::ConfigureWindowEvent(p->window, event_time, x(), y(), static_cast<uint32_t>(e->size().width()), static_cast<uint32_t>(e->size().height())));
+int VulkanWindow::resizeDebounce() const
+{
+    return p->resizeDebounce;
+}
+
+void VulkanWindow::setResizeDebounce(int milliseconds)
+{
+    p->resizeDebounce = std::max(0, milliseconds);
 }
 
 void VulkanWindow::moveEvent(QMoveEvent *e)
@@ -403,14 +1484,19 @@ void VulkanWindow::moveEvent(QMoveEvent *e)
     vsg::clock::time_point event_time = vsg::clock::now();
 
     if (p->initialized)
-        p->window->bufferedEvents.emplace_back(new vsg::ConfigureWindowEvent(p->window, event_time, e->pos().x(), e->pos().y(), static_cast<uint32_t>(size().width()), static_cast<uint32_t>(size().height())));
+    {
+        p->window->bufferedEvents.push(vsg::ConfigureWindowEvent::create(p->window, event_time, e->pos().x(), e->pos().y(), static_cast<uint32_t>(size().width()), static_cast<uint32_t>(size().height())));
+        requestRender();
+    }
 }
 
 void VulkanWindow::wheelEvent(QWheelEvent *e)
 {
     vsg::clock::time_point event_time = vsg::clock::now();
 
-    p->window->bufferedEvents.emplace_back(new vsg::ScrollWheelEvent(p->window, event_time, e->angleDelta().y() < 0 ? vsg::vec3(0.0f, -1.0f, 0.0f) : vsg::vec3(0.0f, 1.0f, 0.0f)));
+    p->window->bufferedEvents.push(p->window->eventPool.scrollWheelEvent(p->window, event_time, e->angleDelta().y() < 0 ? vsg::vec3(0.0f, -1.0f, 0.0f) : vsg::vec3(0.0f, 1.0f, 0.0f)));
+
+    requestRender();
 }
 
 void VulkanWindow::setClearColor(const QColor &color)
@@ -428,48 +1514,259 @@ void VulkanWindow::setClearColor(const QColor &color)
 
     if (p->initialized)
     {
-        p->window->clearColor() = clearColor;
-
-        p->commandGraph->getChildren().clear();
-        p->commandGraph->addChild(vsg::createRenderGraphForView(p->window, p->camera, p->scenegraph));
+        p->context->runBetweenFrames([this, clearColor, clearDepthStencil = p->clearDepthStencil]() {
+            p->window->clearColor() = clearColor;
+            p->updateClearValues(clearColor, clearDepthStencil);
+        });
+        requestRender();
     }
 }
 
-bool VulkanWindow::loadFile(const QString &filename)
+void VulkanWindow::setClearDepthStencil(float depth, uint32_t stencil)
 {
+    p->clearDepthStencil = {depth, stencil};
 
-    if (auto node = vsg::read_cast<vsg::Node>(filename.toStdString()); node.valid())
+    if (p->initialized)
     {
-        qCDebug(lc) << "Adding node to scene" << filename;
+        p->context->runBetweenFrames([this, clearColor = p->clearColor, clearDepthStencil = p->clearDepthStencil]() {
+            p->updateClearValues(clearColor, clearDepthStencil);
+        });
+        requestRender();
+    }
+}
 
-//        auto root = vsg::StateGroup::create();
-//        p->modelRoot->addChild(root);
+int VulkanWindow::loadFile(const QString &filename)
+{
+    return p->context->loader.load(filename);
+}
 
-        p->modelRoot->addChild(node);
-        p->viewer->compile();
-        return true;
-    }
+void VulkanWindow::cancelLoad(int id)
+{
+    p->context->loader.cancel(id);
+}
 
-    return false;
+void VulkanWindow::cancelAllLoads()
+{
+    p->context->loader.cancelAll();
 }
 
 vsg::Instance *VulkanWindow::instance()
 {
-    return p->vsgInstance;
+    return p->context->vsgInstance;
 }
 
-void VulkanWindow::render()
+VulkanWindow::RenderMode VulkanWindow::renderMode() const
+{
+    return p->context->renderMode;
+}
+
+void VulkanWindow::setRenderMode(RenderMode mode)
+{
+    p->context->renderMode = mode;
+    requestRender();
+}
+
+bool VulkanWindow::isAnimating() const
+{
+    return p->context->animating;
+}
+
+void VulkanWindow::setAnimating(bool animating)
+{
+    p->context->animating = animating;
+    if (animating)
+        requestRender();
+}
+
+int VulkanWindow::pick(const QPoint &pixel)
+{
+    const int id = p->context->nextPickId++;
+    QPointer<VulkanWindow> self(this);
+
+    // self is only read on the GUI thread, the application outlives every window
+    auto report = [self, id](const PickResult &result) {
+        QMetaObject::invokeMethod(QCoreApplication::instance(), [self, id, result]() {
+            if (self)
+                emit self->picked(id, result);
+        }, Qt::QueuedConnection);
+    };
+
+    if (!p->camera || width() <= 0 || height() <= 0)
+    {
+        report({});
+        return id;
+    }
+
+    // the camera is only read between two frames, the frame loop may run on its own thread
+    const double x = 2.0 * (pixel.x() + 0.5) / width() - 1.0;
+    const double y = 2.0 * (pixel.y() + 0.5) / height() - 1.0;
+
+    p->context->runBetweenFrames([this, x, y, report]() {
+        // the pixel's ray between the near and far plane
+        const auto view = p->camera->viewMatrix->transform();
+        const auto inverse = vsg::inverse(p->camera->projectionMatrix->transform() * view);
+
+        auto unproject = [&](const vsg::dmat4 &matrix, const vsg::dvec4 &v) {
+            const auto result = matrix * v;
+            return vsg::dvec3(result.x, result.y, result.z) / result.w;
+        };
+
+        auto start = unproject(inverse, vsg::dvec4(x, y, 0.0, 1.0));
+        auto end = unproject(inverse, vsg::dvec4(x, y, 1.0, 1.0));
+
+        // depth 0 is the near plane or the far plane, depending on the projection
+        const auto eye = unproject(vsg::inverse(view), vsg::dvec4(0.0, 0.0, 0.0, 1.0));
+        if (vsg::length(end - eye) < vsg::length(start - eye))
+            std::swap(start, end);
+
+        // the context stays alive until the pick is done
+        p->context->picker.intersectAsync(start, end, [context = p->context, report](const vsgQt::Picker::Hit &hit) {
+            if (hit.valid)
+            {
+                std::scoped_lock lock(context->selectionMutex);
+                context->selection = hit.bounds;
+            }
+
+            PickResult result;
+            result.hit = hit.valid;
+            for (auto &node : hit.nodePath)
+                result.nodePath.append(node.get());
+            result.worldPosition = QVector3D(static_cast<float>(hit.worldPosition.x), static_cast<float>(hit.worldPosition.y), static_cast<float>(hit.worldPosition.z));
+            result.primitiveIndex = static_cast<int>(hit.primitiveIndex);
+            result.instanceIndex = static_cast<int>(hit.instanceIndex);
+            report(result);
+        });
+    });
+    requestRender();
+
+    return id;
+}
+
+VulkanWindow::PresentMode VulkanWindow::presentMode() const
+{
+    if (p->window && p->window->presentModeFor(vsgQt::toVkPresentMode(p->presentMode)) == VK_PRESENT_MODE_FIFO_KHR)
+        return PresentMode::Fifo;
+
+    return p->presentMode;
+}
+
+void VulkanWindow::setPresentMode(PresentMode mode)
+{
+    p->presentMode = mode;
+    applySwapchainPreferences();
+}
+
+int VulkanWindow::framesInFlight() const
+{
+    return p->framesInFlight;
+}
+
+void VulkanWindow::setFramesInFlight(int count)
+{
+    p->framesInFlight = std::max(2, count);
+    applySwapchainPreferences();
+}
+
+void VulkanWindow::applySwapchainPreferences()
+{
+    if (!p->initialized || !p->window)
+        return;
+
+    // the swapchain is rebuilt between two frames, modes the surface lacks fall back to FIFO
+    p->context->runBetweenFrames([this, presentMode = vsgQt::toVkPresentMode(p->presentMode), imageCount = static_cast<uint32_t>(p->framesInFlight)]() {
+        p->window->setSwapchainPreferences(presentMode, imageCount);
+        p->window->rebuildSwapchain();
+
+        // the timestamp queries of the first view follow its number of frames in flight
+        auto &context = *p->context;
+        if (!context.views.empty() && context.views.front() == this)
+            context.profiler.setupGpuTimer(p->window->getOrCreateDevice(), p->commandGraph, static_cast<uint32_t>(p->window->numFrames()));
+    });
+    requestRender();
+}
+
+void VulkanWindow::frameAll()
+{
+    if (!p->initialized || !p->lookAt)
+        return;
+
+    p->context->runBetweenFrames([this]() {
+        const auto bounds = p->context->sceneBounds.bounds();
+        vsgQt::frameBounds(bounds, bounds, p->lookAt, p->camera->projectionMatrix);
+    });
+    requestRender();
+}
+
+void VulkanWindow::frameSelection()
 {
-    if (p->viewer->advanceToNextFrame())
+    if (!p->initialized || !p->lookAt)
+        return;
+
+    vsg::dbox selection;
     {
-        p->viewer->handleEvents();
-        p->viewer->update();
-        p->viewer->recordAndSubmit();
-        p->viewer->present();
+        std::scoped_lock lock(p->context->selectionMutex);
+        selection = p->context->selection;
     }
 
-    //qCDebug(lc) << __func__;
-    requestUpdate();
+    if (!selection.valid())
+        return;
+
+    p->context->runBetweenFrames([this, selection]() {
+        vsgQt::frameBounds(selection, p->context->sceneBounds.bounds(), p->lookAt, p->camera->projectionMatrix);
+    });
+    requestRender();
+}
+
+QString VulkanWindow::frameProfileSummary() const
+{
+    return p->context->profiler.summaryText();
+}
+
+bool VulkanWindow::exportFrameProfile(const QString &filename) const
+{
+    return p->context->profiler.exportCsv(filename);
+}
+
+bool VulkanWindow::startCapture(const QString &directory, CaptureFormat format)
+{
+    if (!p->initialized)
+        return false;
+
+    const bool started = p->context->capture.start(directory, format == CaptureFormat::Raw ? vsgQt::FrameCapture::Format::Raw : vsgQt::FrameCapture::Format::Png);
+    requestRender();
+    return started;
+}
+
+void VulkanWindow::stopCapture()
+{
+    if (!p->context->capture.isRecording())
+        return;
+
+    p->context->capture.stop();
+    p->context->captureStopping = true;
+    requestRender();
+}
+
+bool VulkanWindow::isCapturing() const
+{
+    return p->context->capture.isRecording();
+}
+
+VulkanWindow::CaptureStats VulkanWindow::captureStats() const
+{
+    const auto stats = p->context->capture.stats();
+    return {static_cast<qint64>(stats.captured), static_cast<qint64>(stats.written), static_cast<qint64>(stats.dropped)};
+}
+
+void VulkanWindow::requestRender()
+{
+    p->context->requestFrame();
+}
+
+void VulkanWindow::render()
+{
+    if (p->context->renderFrame())
+        requestUpdate();
 }
 
 vsgQt::KeyboardMap::KeyboardMap()
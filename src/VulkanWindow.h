@@ -1,8 +1,11 @@
 #pragma once
 
+#include <QVector>
+#include <QVector3D>
 #include <QWindow>
 
 namespace vsg {
+class Node;
 class Viewer;
 class Window;
 class StateGroup;
@@ -21,15 +24,188 @@ class VulkanWindow : public QWindow
     Q_OBJECT
 public:
 
-    VulkanWindow();
+    enum class RenderMode
+    {
+        Continuous,
+        OnDemand
+    };
+
+    // FIFO waits for vertical blank, MAILBOX replaces the queued image,
+    // IMMEDIATE presents right away and may tear
+    enum class PresentMode
+    {
+        Fifo,
+        Mailbox,
+        Immediate
+    };
+
+    // what the last frame recorded, summed over all views
+    struct SceneStatistics
+    {
+        qint64 drawCalls{0};
+        qint64 indexedPrimitives{0};
+        qint64 pipelineBinds{0};
+        qint64 descriptorBinds{0};
+        qint64 culledNodes{0};
+    };
+
+    enum class CaptureFormat
+    {
+        Png,
+        Raw
+    };
+
+    struct CaptureStats
+    {
+        qint64 captured{0};
+        qint64 written{0};
+        qint64 dropped{0};
+    };
+
+    // where the camera looks at the scene from when the view is first shown
+    enum class ViewDirection
+    {
+        Front,
+        Top,
+        Side,
+        Perspective
+    };
+
+    // estimated device memory of a compiled model
+    struct ModelMemory
+    {
+        QString name;
+        qint64 vertexBytes{0};
+        qint64 indexBytes{0};
+        qint64 textureBytes{0};
+        qint64 descriptorBytes{0};
+    };
+
+    // what is under a pixel, see pick()
+    struct PickResult
+    {
+        bool hit{false};
+        // from the scene's model root down to the draw
+        QVector<vsg::Node *> nodePath;
+        QVector3D worldPosition;
+        int primitiveIndex{0};
+        int instanceIndex{0};
+    };
+
+    // views created with shareWith share its Vulkan instance, device, scene
+    // and frame loop
+    explicit VulkanWindow(VulkanWindow *shareWith = nullptr);
     virtual ~VulkanWindow() override;
 
     QColor clearColor() const;
     void setClearColor(const QColor &color);
-    bool loadFile(const QString &filename);
+    void setClearDepthStencil(float depth, uint32_t stencil);
+    int loadFile(const QString &filename);
 
     vsg::Instance* instance();
 
+    RenderMode renderMode() const;
+    void setRenderMode(RenderMode mode);
+
+    bool isAnimating() const;
+    void setAnimating(bool animating);
+
+    int resizeDebounce() const;
+    void setResizeDebounce(int milliseconds);
+
+    bool isThreadedRendering() const;
+    void setThreadedRendering(bool threaded);
+
+    // dense meshes of loaded models are replaced by generated levels of detail
+    bool isLevelOfDetailEnabled() const;
+    void setLevelOfDetailEnabled(bool enabled);
+
+    // loaded models share identical state and merge small draws, see SceneOptimizer
+    bool isSceneOptimizationEnabled() const;
+    void setSceneOptimizationEnabled(bool enabled);
+
+    // repeated copies of the same geometry in a loaded model become one instanced draw
+    bool isAutoInstancingEnabled() const;
+    void setAutoInstancingEnabled(bool enabled);
+
+    // RGBA8 textures of loaded models are transcoded to BC1/BC3 with mipmaps
+    bool isTextureCompressionEnabled() const;
+    void setTextureCompressionEnabled(bool enabled);
+
+    // counts draws, primitives, binds and culled nodes of every frame in an
+    // extra traversal of the scene, see SceneStats
+    bool isSceneStatisticsEnabled() const;
+    void setSceneStatisticsEnabled(bool enabled);
+    SceneStatistics sceneStatistics() const;
+
+    QVector<ModelMemory> modelMemory() const;
+
+    // device local budget and usage, from VK_EXT_memory_budget when available.
+    // Loads that do not fit are first retried without mipmaps, then refused.
+    qint64 deviceMemoryBudget() const;
+    qint64 deviceMemoryUsage() const;
+
+    // caps the budget further, 0 for the device's budget
+    qint64 memoryLimit() const;
+    void setMemoryLimit(qint64 bytes);
+
+    // memory paged databases may keep in high resolution tiles
+    qint64 pagingBudget() const;
+    void setPagingBudget(qint64 bytes);
+
+    // more than one thread records the scene into secondary command buffers
+    int recordingThreads() const;
+    void setRecordingThreads(int numThreads);
+
+    // swapchain settings, changing them rebuilds the swapchain. Frames in
+    // flight is the number of swapchain images, vsg keeps one frame per image.
+    // presentMode() is the mode in use, FIFO where the surface lacks the one set.
+    PresentMode presentMode() const;
+    void setPresentMode(PresentMode mode);
+    int framesInFlight() const;
+    void setFramesInFlight(int count);
+
+    ViewDirection viewDirection() const;
+    void setViewDirection(ViewDirection direction);
+
+    // Picks the triangle under pixel on a worker thread and reports it with
+    // picked(). The ray is taken from the camera before the next frame.
+    // Models are pickable once their hierarchy has been built in the
+    // background after loading. Returns the id of the request.
+    int pick(const QPoint &pixel);
+
+    // re-fit the camera to the whole scene, or to the mesh of the last hit
+    // picked in any view, from the cached bounds of the models
+    void frameAll();
+    void frameSelection();
+
+    QString frameProfileSummary() const;
+    bool exportFrameProfile(const QString &filename) const;
+
+    // Records the frames of the first view to an image sequence in
+    // directory, encoded on worker threads. Frames are dropped rather than
+    // waited for when the encoders fall behind. stopCapture() returns at
+    // once, captureFinished() follows when the last frame is written.
+    bool startCapture(const QString &directory, CaptureFormat format = CaptureFormat::Png);
+    void stopCapture();
+    bool isCapturing() const;
+    CaptureStats captureStats() const;
+
+public slots:
+
+    void requestRender();
+
+    void cancelLoad(int id);
+    void cancelAllLoads();
+
+signals:
+
+    void loadStarted(int id, const QString &filename);
+    void loadProgress(int id, int percent);
+    void loadFinished(int id, const QString &filename, bool success);
+    void frameProfileUpdated(const QString &summary);
+    void picked(int id, const VulkanWindow::PickResult &result);
+    void captureFinished();
 
 protected:
 
@@ -41,12 +217,16 @@ protected:
     void keyReleaseEvent(QKeyEvent *) override;
     void mouseMoveEvent(QMouseEvent *) override;
     void mousePressEvent(QMouseEvent *) override;
+    void mouseDoubleClickEvent(QMouseEvent *) override;
     void mouseReleaseEvent(QMouseEvent *) override;
     void resizeEvent(QResizeEvent *) override;
     void moveEvent(QMoveEvent *) override;
     void wheelEvent(QWheelEvent *) override;
 
 private:
+    void applySwapchainPreferences();
+
+    struct Context;
     struct Private;
     QScopedPointer<Private> p;
 };
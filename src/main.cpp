@@ -1,11 +1,89 @@
 #include "MainWindow.h"
+#include "VulkanWindow.h"
 
 #include <QApplication>
+#include <QCommandLineParser>
+#include <QMap>
 
 int main(int argc, char *argv[])
 {
     QApplication a(argc, argv);
-    MainWindow w;
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+
+    QCommandLineOption renderThreadOption("render-thread", QCoreApplication::translate("main", "Run the frame loop on its own thread."));
+    parser.addOption(renderThreadOption);
+
+    QCommandLineOption viewsOption("views", QCoreApplication::translate("main", "Number of views of the scene, 1 to 4."), "count", "1");
+    parser.addOption(viewsOption);
+
+    QCommandLineOption recordThreadsOption("record-threads", QCoreApplication::translate("main", "Record the scene on this many threads."), "count", "1");
+    parser.addOption(recordThreadsOption);
+
+    QCommandLineOption pagingBudgetOption("paging-budget", QCoreApplication::translate("main", "Memory for tiles of paged databases, in MB."), "MB", "512");
+    parser.addOption(pagingBudgetOption);
+
+    QCommandLineOption memoryLimitOption("memory-limit", QCoreApplication::translate("main", "Device memory models may use, in MB, 0 for the device's budget."), "MB", "0");
+    parser.addOption(memoryLimitOption);
+
+    QCommandLineOption presentModeOption("present-mode", QCoreApplication::translate("main", "Swapchain present mode, fifo, mailbox or immediate."), "mode", "mailbox");
+    parser.addOption(presentModeOption);
+
+    QCommandLineOption framesInFlightOption("frames-in-flight", QCoreApplication::translate("main", "Number of swapchain images, at least 2."), "count", "3");
+    parser.addOption(framesInFlightOption);
+
+    QCommandLineOption captureFormatOption("capture-format", QCoreApplication::translate("main", "Image format of recorded frames, png or raw."), "format", "png");
+    parser.addOption(captureFormatOption);
+
+    parser.process(a);
+
+    bool valid = false;
+    const auto numViews = parser.value(viewsOption).toInt(&valid);
+    if (!valid || numViews < 1 || numViews > 4)
+    {
+        qCritical("Invalid number of views %s, expected 1 to 4.", qPrintable(parser.value(viewsOption)));
+        return 1;
+    }
+
+    const QMap<QString, VulkanWindow::PresentMode> presentModes{
+        {"fifo", VulkanWindow::PresentMode::Fifo},
+        {"mailbox", VulkanWindow::PresentMode::Mailbox},
+        {"immediate", VulkanWindow::PresentMode::Immediate}
+    };
+    const auto presentMode = parser.value(presentModeOption).toLower();
+    if (!presentModes.contains(presentMode))
+    {
+        qCritical("Invalid present mode %s, expected fifo, mailbox or immediate.", qPrintable(parser.value(presentModeOption)));
+        return 1;
+    }
+
+    const auto framesInFlight = parser.value(framesInFlightOption).toInt(&valid);
+    if (!valid || framesInFlight < 2)
+    {
+        qCritical("Invalid number of frames in flight %s, expected at least 2.", qPrintable(parser.value(framesInFlightOption)));
+        return 1;
+    }
+
+    const QMap<QString, VulkanWindow::CaptureFormat> captureFormats{
+        {"png", VulkanWindow::CaptureFormat::Png},
+        {"raw", VulkanWindow::CaptureFormat::Raw}
+    };
+    const auto captureFormat = parser.value(captureFormatOption).toLower();
+    if (!captureFormats.contains(captureFormat))
+    {
+        qCritical("Invalid capture format %s, expected png or raw.", qPrintable(parser.value(captureFormatOption)));
+        return 1;
+    }
+
+    MainWindow w(numViews);
+    w.vulkanWindow()->setThreadedRendering(parser.isSet(renderThreadOption));
+    w.vulkanWindow()->setRecordingThreads(parser.value(recordThreadsOption).toInt());
+    w.vulkanWindow()->setPagingBudget(parser.value(pagingBudgetOption).toLongLong() << 20);
+    w.vulkanWindow()->setMemoryLimit(parser.value(memoryLimitOption).toLongLong() << 20);
+    w.setPresentMode(presentModes.value(presentMode));
+    w.setFramesInFlight(framesInFlight);
+    w.setCaptureFormat(captureFormats.value(captureFormat));
     w.show();
     return a.exec();
 }
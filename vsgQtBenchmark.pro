@@ -0,0 +1,37 @@
+QT       += core gui
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+DESTDIR = bin
+
+INCLUDEPATH += src
+
+SOURCES += \
+    benchmark/main.cpp \
+    benchmark/CameraPath.cpp \
+    src/AutoInstancer.cpp \
+    src/BinaryCache.cpp \
+    src/FrameCapture.cpp \
+    src/FrameProfiler.cpp \
+    src/LodGenerator.cpp \
+    src/ParallelRenderGraph.cpp \
+    src/SceneBounds.cpp \
+    src/SceneOptimizer.cpp \
+    src/SceneSetup.cpp \
+    src/SceneStats.cpp
+
+HEADERS += \
+    benchmark/CameraPath.h \
+    src/AutoInstancer.h \
+    src/BinaryCache.h \
+    src/FrameCapture.h \
+    src/FrameProfiler.h \
+    src/FunctionRunnable.h \
+    src/LodGenerator.h \
+    src/ParallelRenderGraph.h \
+    src/SceneBounds.h \
+    src/SceneOptimizer.h \
+    src/SceneSetup.h \
+    src/SceneStats.h
+
+include(vsg.pri)
@@ -11,32 +11,53 @@ DESTDIR = bin
 
 SOURCES += \
     src/main.cpp \
+    src/AutoInstancer.cpp \
+    src/BinaryCache.cpp \
+    src/FrameCapture.cpp \
+    src/FrameProfiler.cpp \
+    src/LodGenerator.cpp \
     src/MainWindow.cpp \
+    src/MemoryBudget.cpp \
+    src/ModelLoader.cpp \
+    src/PagingBudget.cpp \
+    src/ParallelRenderGraph.cpp \
+    src/Picker.cpp \
+    src/PipelineCache.cpp \
+    src/SceneBounds.cpp \
+    src/SceneOptimizer.cpp \
+    src/SceneSetup.cpp \
+    src/SceneStats.cpp \
+    src/ShaderCache.cpp \
+    src/SubgraphCompiler.cpp \
+    src/TextureCompressor.cpp \
     src/VulkanWindow.cpp
 
 HEADERS += \
+    src/AutoInstancer.h \
+    src/BinaryCache.h \
+    src/EventPool.h \
+    src/EventQueue.h \
+    src/FrameCapture.h \
+    src/FrameProfiler.h \
+    src/FunctionRunnable.h \
+    src/LodGenerator.h \
     src/MainWindow.h \
+    src/MemoryBudget.h \
+    src/ModelLoader.h \
+    src/PagingBudget.h \
+    src/ParallelRenderGraph.h \
+    src/Picker.h \
+    src/PipelineCache.h \
+    src/SceneBounds.h \
+    src/SceneOptimizer.h \
+    src/SceneSetup.h \
+    src/SceneStats.h \
+    src/ShaderCache.h \
+    src/SubgraphCompiler.h \
+    src/TextureCompressor.h \
     src/VulkanWindow.h
 
 FORMS += \
     src/MainWindow.ui
 
-win32 {
-    DEFINES *= VK_USE_PLATFORM_WIN32_KHR
-    INCLUDEPATH *= $$(VSG_ROOT)/include
-    CONFIG(debug, debug|release) {
-        LIBS *= -L$$(VSG_ROOT)/debug/lib -L$$(VULKAN_SDK)/Lib -lvsgd -lvulkan-1 -lGenericCodeGend -lMachineIndependentd -lOGLCompilerd -lOSDependentd -lglslangd -lspirv-cross-cd -lspirv-cross-cored -lspirv-cross-cppd -lspirv-cross-glsld -lspirv-cross-reflectd -lspirv-cross-utild -lSPIRVd -lSPIRV-Tools-optd -lSPIRV-Toolsd
-    } else {
-        LIBS *= -L$$(VSG_ROOT)/lib -L$$(VULKAN_SDK)/Lib -lvsg -lvulkan-1 -lGenericCodeGen -lMachineIndependent -lOGLCompiler -lOSDependent -lglslang -lspirv-cross-c -lspirv-cross-core -lspirv-cross-cpp -lspirv-cross-glsl -lspirv-cross-reflect -lspirv-cross-util -lSPIRV -lSPIRV-Tools-opt -lSPIRV-Tools
-    }
-
-    #QT_BIN_DIR = $$dirname(QMAKE_QMAKE)
-    #DEPLOY_TARGET = $$shell_quote($${DESTDIR}/$${TARGET}.exe)
-    #QMAKE_POST_LINK += $$QT_BIN_DIR\\windeployqt --no-compiler-runtime --dir $${DESTDIR} --plugindir $${DESTDIR}/plugins $${DEPLOY_ARGS} $${DEPLOY_TARGET} $$escape_expand(\\n\\t)
-}
-
-unix {
-    DEFINES *= VK_USE_PLATFORM_XCB_KHR
-    INCLUDEPATH *= $$(VSG_ROOT)/include $$(VULKAN_SDK)/include
-    LIBS *= -L$$(VSG_ROOT)/lib -L$$(VULKAN_SDK)/lib -lvsg -lvulkan -lglslang -lOGLCompiler -lOSDependent -lHLSL -lSPIRV -lSPIRV-Tools-opt -lSPIRV-Tools
-}
+include(vsg.pri)